@@ -0,0 +1,63 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#ifdef MODO_DLOPEN
+#include <dlfcn.h>
+#endif
+#include "mapas.h"
+
+/*
+ * Programa medido por bench_arranque: llama a cos como problema4 (enlace
+ * estatico o dinamico, segun como se compile) o como problema4_3 (dlopen
+ * con MODO_DLOPEN = RTLD_LAZY o RTLD_NOW). Justo despues de la primera
+ * llamada imprime el reloj monotono, las regiones del mapa, cuantas son de
+ * libm y los fallos de pagina hasta ese momento.
+ */
+
+/* En bss para no crear regiones ni provocar fallos antes de medir. */
+static char texto[MAPA_CAPACIDAD];
+static struct region regiones[MAPA_MAX_REGIONES];
+
+int main(int argc, char *argv[]) {
+    struct mapa mapa = { texto, sizeof(texto), 0, regiones, 0, MAPA_MAX_REGIONES };
+    double numero = argc - 1.0;         /* que el compilador no calcule cos(0) */
+    volatile double resultado;
+    struct timespec ts;
+    struct rusage uso;
+    size_t i, libm = 0;
+#ifdef MODO_DLOPEN
+    double (*cos_ptr)(double);
+    void *handle = dlopen("libm.so.6", MODO_DLOPEN);
+
+    if (!handle) {
+        fprintf(stderr, "Error al cargar libm: %s\n", dlerror());
+        return 1;
+    }
+    cos_ptr = dlsym(handle, "cos");
+    if (!cos_ptr) {
+        fprintf(stderr, "Error al obtener cos: %s\n", dlerror());
+        return 1;
+    }
+    resultado = cos_ptr(numero);
+#else
+    resultado = cos(numero);
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    getrusage(RUSAGE_SELF, &uso);
+    (void)resultado;
+
+    if (mapa_leer(&mapa, 0)) {
+        perror("/proc/self/maps");
+        return 1;
+    }
+    for (i = 0; i < mapa.num_regiones; i++)
+        if (memmem(mapa.regiones[i].nombre, mapa.regiones[i].longitud_nombre, "libm", 4))
+            libm++;
+
+    printf("%lld %zu %zu %ld %ld\n", ts.tv_sec * 1000000000LL + ts.tv_nsec, mapa.num_regiones, libm,
+           uso.ru_minflt, uso.ru_majflt);
+    return 0;
+}
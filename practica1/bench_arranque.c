@@ -0,0 +1,171 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libgen.h>
+#include <limits.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+/*
+ * Cuanto cuesta llegar a la primera llamada a cos segun como se enlace
+ * libm. Lanza N veces cada variante de arranque.c (ver el Makefile):
+ *
+ *   estatico    problema4: todo en el ejecutable
+ *   lazy        problema4_2: libm dinamica, simbolos resueltos en la primera llamada
+ *   now         libm dinamica enlazada con -z now: todo resuelto al cargar
+ *   dlopen      problema4_3: dlopen(RTLD_LAZY) + dlsym
+ *   dlopen_now  dlopen(RTLD_NOW) + dlsym
+ *
+ * El tiempo va desde justo antes de posix_spawn hasta que la primera
+ * llamada a cos vuelve (el hijo imprime su reloj monotono). Las regiones y
+ * fallos de pagina son la mediana de lo que cuenta el hijo en ese momento.
+ */
+#define USO "Uso: bench_arranque [-n repeticiones] [variante...]\n"
+#define PREFIJO "arranque_"
+
+extern char **environ;
+
+static const char *variantes_defecto[] = { "estatico", "lazy", "now", "dlopen", "dlopen_now" };
+
+struct ejecucion {
+    long long ns;
+    long regiones, libm, minflt, majflt;
+};
+
+static long long ahora_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int lanzar(const char *ruta, struct ejecucion *e) {
+    posix_spawn_file_actions_t acciones;
+    char *argv[] = { (char *)ruta, NULL };
+    char linea[256];
+    long long inicio, fin;
+    ssize_t leidos, total = 0;
+    int tuberia[2], estado;
+    pid_t pid;
+
+    if (pipe(tuberia))
+        return -1;
+    posix_spawn_file_actions_init(&acciones);
+    posix_spawn_file_actions_adddup2(&acciones, tuberia[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&acciones, tuberia[0]);
+
+    inicio = ahora_ns();
+    errno = posix_spawn(&pid, ruta, &acciones, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&acciones);
+    close(tuberia[1]);
+    if (errno) {
+        perror(ruta);
+        close(tuberia[0]);
+        return -1;
+    }
+    while ((leidos = read(tuberia[0], linea + total, sizeof(linea) - 1 - total)) > 0)
+        total += leidos;
+    close(tuberia[0]);
+    waitpid(pid, &estado, 0);
+    linea[total] = '\0';
+
+    if (!WIFEXITED(estado) || WEXITSTATUS(estado) ||
+        sscanf(linea, "%lld %ld %ld %ld %ld", &fin, &e->regiones, &e->libm, &e->minflt, &e->majflt) != 5) {
+        fprintf(stderr, "%s: salida inesperada\n", ruta);
+        return -1;
+    }
+    e->ns = fin - inicio;
+    return 0;
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int cmp_l(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Mediana de un campo long de las ejecuciones. */
+static long mediana(struct ejecucion *e, int n, size_t campo, long *tmp) {
+    int i;
+
+    for (i = 0; i < n; i++)
+        tmp[i] = *(long *)((char *)&e[i] + campo);
+    qsort(tmp, n, sizeof(*tmp), cmp_l);
+    return tmp[n / 2];
+}
+
+int main(int argc, char *argv[]) {
+    const char **variantes = variantes_defecto;
+    char programa[PATH_MAX], ruta[PATH_MAX + 64];
+    const char *dir;
+    struct ejecucion *e;
+    long long *ns, suma;
+    long *tmp;
+    int opcion, repeticiones = 200, num_variantes = 5, v, n;
+
+    while ((opcion = getopt(argc, argv, "n:")) != -1) {
+        if (opcion != 'n') {
+            fprintf(stderr, USO);
+            return 1;
+        }
+        repeticiones = atoi(optarg);
+    }
+    if (repeticiones < 1) {
+        fprintf(stderr, USO);
+        return 1;
+    }
+    if (optind < argc) {
+        variantes = (const char **)argv + optind;
+        num_variantes = argc - optind;
+    }
+
+    /* Las variantes estan junto a este programa. */
+    snprintf(programa, sizeof(programa), "%s", argv[0]);
+    dir = dirname(programa);
+
+    e = calloc(repeticiones, sizeof(*e));
+    ns = calloc(repeticiones, sizeof(*ns));
+    tmp = calloc(repeticiones, sizeof(*tmp));
+    if (!e || !ns || !tmp) {
+        perror("Error al reservar las muestras");
+        return 1;
+    }
+
+    printf("modo,repeticiones,p50_us,p90_us,p99_us,media_us,regiones,regiones_libm,minflt,majflt\n");
+    for (v = 0; v < num_variantes; v++) {
+        snprintf(ruta, sizeof(ruta), "%s/" PREFIJO "%s", dir, variantes[v]);
+        lanzar(ruta, &e[0]);            /* calienta la cache de paginas */
+        for (n = 0, suma = 0; n < repeticiones; n++) {
+            if (lanzar(ruta, &e[n]))
+                break;
+            ns[n] = e[n].ns;
+            suma += e[n].ns;
+        }
+        if (n < repeticiones)
+            continue;
+        qsort(ns, n, sizeof(*ns), cmp_ll);
+        printf("%s,%d,%.1f,%.1f,%.1f,%.1f,%ld,%ld,%ld,%ld\n", variantes[v], n,
+               ns[n / 2] / 1e3, ns[(int)(0.90 * (n - 1))] / 1e3, ns[(int)(0.99 * (n - 1))] / 1e3,
+               suma / 1e3 / n,
+               mediana(e, n, offsetof(struct ejecucion, regiones), tmp),
+               mediana(e, n, offsetof(struct ejecucion, libm), tmp),
+               mediana(e, n, offsetof(struct ejecucion, minflt), tmp),
+               mediana(e, n, offsetof(struct ejecucion, majflt), tmp));
+        fflush(stdout);
+    }
+    free(e);
+    free(ns);
+    free(tmp);
+    return 0;
+}
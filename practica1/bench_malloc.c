@@ -0,0 +1,337 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "mapas.h"
+
+/*
+ * problema3 hace un malloc(14000) y mira en el mapa si ha caido en el heap
+ * de brk. Aqui se repite a escala: para cada tamaño (a ambos lados de
+ * M_MMAP_THRESHOLD, 128 KiB por defecto en glibc), cada asignador y 1 o N
+ * hilos, cada hilo reserva lotes de LOTE objetos, escribe en ellos y los
+ * libera. Se comparan:
+ *
+ *   glibc   malloc/free
+ *   arena   reserva por desplazamiento en una zona propia; se vacia por lotes
+ *   pool    listas libres por clase de tamaño (potencias de 2), por hilo
+ *
+ * Por cada combinacion se imprime una fila CSV con operaciones por segundo
+ * (malloc + free), lo que crece el RSS y las regiones del mapa nuevas,
+ * eliminadas o que cambian de tamaño, medidos antes de devolver la memoria
+ * de los asignadores.
+ */
+#define USO "Uso: bench_malloc [-n ops por hilo] [-t hilos] [-u umbral mmap] [tamaño...]\n"
+#define LOTE 32
+#define MAX_HILOS 256
+#define CLASES 24                       /* 16 B .. 128 MiB */
+#define TROZO_POOL (256 * 1024)
+
+static const size_t tamanos_defecto[] = {
+    16, 64, 256, 1024, 4096, 14000, 65536, 126976, 131072, 139264, 262144, 1048576
+};
+
+/* Arena: un solo bloque mmap; liberar no hace nada y fin_lote lo vacia. */
+struct arena {
+    char *base;
+    size_t usado;
+    size_t capacidad;
+};
+
+/* Pool: lista libre por clase; los trozos se encadenan para devolverlos al final. */
+struct pool {
+    void *libres[CLASES];
+    void *trozos;
+};
+
+struct trabajador {
+    pthread_t id;
+    const struct asignador *asignador;
+    size_t tamano;
+    long ops;
+    int fallos;
+    double inicio, fin;                 /* cada hilo mide su propio intervalo */
+    union {
+        struct arena arena;
+        struct pool pool;
+    } estado;
+};
+
+struct asignador {
+    const char *nombre;
+    void *(*reservar)(void *estado, size_t tamano);
+    void (*liberar)(void *estado, void *p, size_t tamano);
+    void (*fin_lote)(void *estado);
+    void (*destruir)(void *estado);
+};
+
+static long ops_por_hilo = 50000;
+static pthread_barrier_t barrera;
+
+static void *glibc_reservar(void *estado, size_t tamano) {
+    return malloc(tamano);
+}
+
+static void glibc_liberar(void *estado, void *p, size_t tamano) {
+    free(p);
+}
+
+static size_t redondear(size_t n, size_t a) {
+    return (n + a - 1) / a * a;
+}
+
+static void *arena_reservar(void *estado, size_t tamano) {
+    struct arena *a = estado;
+    void *p;
+
+    if (!a->base) {
+        a->capacidad = redondear(LOTE * redondear(tamano, 16), 4096);
+        a->base = mmap(NULL, a->capacidad, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (a->base == MAP_FAILED) {
+            a->base = NULL;
+            return NULL;
+        }
+    }
+    tamano = redondear(tamano, 16);
+    if (a->usado + tamano > a->capacidad)
+        return NULL;
+    p = a->base + a->usado;
+    a->usado += tamano;
+    return p;
+}
+
+static void arena_liberar(void *estado, void *p, size_t tamano) {
+}
+
+static void arena_fin_lote(void *estado) {
+    ((struct arena *)estado)->usado = 0;
+}
+
+static void arena_destruir(void *estado) {
+    struct arena *a = estado;
+
+    if (a->base)
+        munmap(a->base, a->capacidad);
+}
+
+static int clase(size_t tamano) {
+    int c = 0;
+
+    while (((size_t)16 << c) < tamano)
+        c++;
+    return c;
+}
+
+static void *pool_reservar(void *estado, size_t tamano) {
+    struct pool *pool = estado;
+    int c = clase(tamano);
+    size_t objeto = (size_t)16 << c, bytes, i;
+    char *trozo;
+    void *p;
+
+    if (c >= CLASES)
+        return NULL;
+    if (!pool->libres[c]) {
+        /* Un trozo nuevo: cabecera de 16 bytes (siguiente trozo, tamaño) y objetos. */
+        bytes = redondear(16 + (objeto < TROZO_POOL / 8 ? TROZO_POOL : 8 * objeto), 4096);
+        trozo = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (trozo == MAP_FAILED)
+            return NULL;
+        ((void **)trozo)[0] = pool->trozos;
+        ((size_t *)trozo)[1] = bytes;
+        pool->trozos = trozo;
+        for (i = 16; i + objeto <= bytes; i += objeto) {
+            *(void **)(trozo + i) = pool->libres[c];
+            pool->libres[c] = trozo + i;
+        }
+    }
+    p = pool->libres[c];
+    pool->libres[c] = *(void **)p;
+    return p;
+}
+
+static void pool_liberar(void *estado, void *p, size_t tamano) {
+    struct pool *pool = estado;
+    int c = clase(tamano);
+
+    *(void **)p = pool->libres[c];
+    pool->libres[c] = p;
+}
+
+static void pool_destruir(void *estado) {
+    struct pool *pool = estado;
+    void *trozo, *siguiente;
+
+    for (trozo = pool->trozos; trozo; trozo = siguiente) {
+        siguiente = ((void **)trozo)[0];
+        munmap(trozo, ((size_t *)trozo)[1]);
+    }
+}
+
+static const struct asignador asignadores[] = {
+    { "glibc", glibc_reservar, glibc_liberar, NULL, NULL },
+    { "arena", arena_reservar, arena_liberar, arena_fin_lote, arena_destruir },
+    { "pool", pool_reservar, pool_liberar, NULL, pool_destruir },
+};
+
+static double segundos(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *trabajar(void *arg) {
+    struct trabajador *t = arg;
+    const struct asignador *a = t->asignador;
+    void *objetos[LOTE];
+    long hechas;
+    int i;
+
+    pthread_barrier_wait(&barrera);     /* todos listos: empieza a contar */
+    t->inicio = segundos();
+    for (hechas = 0; hechas < ops_por_hilo; hechas += LOTE) {
+        for (i = 0; i < LOTE; i++) {
+            objetos[i] = a->reservar(&t->estado, t->tamano);
+            if (!objetos[i]) {
+                t->fallos++;
+                continue;
+            }
+            /* Como problema3, se usa la memoria: primer y ultimo byte. */
+            ((char *)objetos[i])[0] = (char)i;
+            ((char *)objetos[i])[t->tamano - 1] = (char)i;
+        }
+        for (i = LOTE - 1; i >= 0; i--)
+            if (objetos[i])
+                a->liberar(&t->estado, objetos[i], t->tamano);
+        if (a->fin_lote)
+            a->fin_lote(&t->estado);
+        t->ops += LOTE;
+    }
+    t->fin = segundos();
+    pthread_barrier_wait(&barrera);     /* fin de la medida */
+    pthread_barrier_wait(&barrera);     /* el hilo principal ya ha mirado el mapa */
+    if (a->destruir)
+        a->destruir(&t->estado);
+    return NULL;
+}
+
+static long rss_kb(struct mapa *arena) {
+    char *p;
+
+    if (mapa_leer_fichero(arena, "/proc/self/smaps_rollup") == -1)
+        return 0;
+    arena->texto[arena->longitud] = '\0';
+    p = strstr(arena->texto, "\nRss:");
+    return p ? strtol(p + 5, NULL, 10) : 0;
+}
+
+static int medir(const struct asignador *a, size_t tamano, int hilos, struct mapa mapas[2],
+                 struct mapa *lectura, struct trabajador *trabajadores) {
+    struct diferencias dif;
+    double inicio, fin;
+    long rss_antes, rss_despues, ops = 0;
+    int i, fallos = 0;
+
+    memset(trabajadores, 0, hilos * sizeof(*trabajadores));
+    pthread_barrier_init(&barrera, NULL, hilos + 1);
+    for (i = 0; i < hilos; i++) {
+        trabajadores[i].asignador = a;
+        trabajadores[i].tamano = tamano;
+        if (pthread_create(&trabajadores[i].id, NULL, trabajar, &trabajadores[i])) {
+            fprintf(stderr, "Error al crear el hilo %d\n", i);
+            exit(1);
+        }
+    }
+
+    /* Las pilas de los hilos ya existen: solo se mide lo del asignador. */
+    rss_antes = rss_kb(lectura);
+    mapa_leer(&mapas[0], 0);
+    pthread_barrier_wait(&barrera);
+    pthread_barrier_wait(&barrera);
+    rss_despues = rss_kb(lectura);
+    mapa_leer(&mapas[1], 0);
+    pthread_barrier_wait(&barrera);
+
+    inicio = trabajadores[0].inicio;
+    fin = trabajadores[0].fin;
+    for (i = 0; i < hilos; i++) {
+        pthread_join(trabajadores[i].id, NULL);
+        if (trabajadores[i].inicio < inicio)
+            inicio = trabajadores[i].inicio;
+        if (trabajadores[i].fin > fin)
+            fin = trabajadores[i].fin;
+        ops += trabajadores[i].ops;
+        fallos += trabajadores[i].fallos;
+    }
+    pthread_barrier_destroy(&barrera);
+
+    mapa_contar_diferencias(&mapas[0], &mapas[1], &dif);
+    printf("%s,%zu,%d,%ld,%.0f,%ld,%d,%d,%d,%d\n", a->nombre, tamano, hilos, ops, ops / (fin - inicio),
+           rss_despues - rss_antes, dif.nuevas, dif.eliminadas, dif.cambiadas, fallos);
+    fflush(stdout);
+    return fallos;
+}
+
+int main(int argc, char *argv[]) {
+    static struct trabajador trabajadores[MAX_HILOS];
+    struct mapa mapas[2], lectura;
+    size_t tamanos[64];
+    int opcion, hilos = sysconf(_SC_NPROCESSORS_ONLN), num_tamanos = 0, i, j, h;
+
+    while ((opcion = getopt(argc, argv, "n:t:u:")) != -1) {
+        switch (opcion) {
+        case 'n':
+            ops_por_hilo = atol(optarg);
+            break;
+        case 't':
+            hilos = atoi(optarg);
+            break;
+        case 'u':
+            /* Fijar el umbral desactiva su ajuste dinamico en glibc. */
+            if (!mallopt(M_MMAP_THRESHOLD, atoi(optarg))) {
+                fprintf(stderr, "mallopt(M_MMAP_THRESHOLD, %s) ha fallado\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, USO);
+            return 1;
+        }
+    }
+    if (ops_por_hilo < LOTE || hilos < 1 || hilos > MAX_HILOS) {
+        fprintf(stderr, USO);
+        return 1;
+    }
+    for (; optind < argc && num_tamanos < 64; optind++)
+        if ((tamanos[num_tamanos] = strtoul(argv[optind], NULL, 0)) > 0)
+            num_tamanos++;
+    if (!num_tamanos)
+        for (; num_tamanos < (int)(sizeof(tamanos_defecto) / sizeof(tamanos_defecto[0])); num_tamanos++)
+            tamanos[num_tamanos] = tamanos_defecto[num_tamanos];
+
+    if (mapa_iniciar(&mapas[0], MAPA_CAPACIDAD, MAPA_MAX_REGIONES) ||
+        mapa_iniciar(&mapas[1], MAPA_CAPACIDAD, MAPA_MAX_REGIONES) ||
+        mapa_iniciar(&lectura, MAPA_CAPACIDAD, 1)) {
+        perror("Error al reservar los mapas");
+        return 1;
+    }
+    lectura.capacidad--;                /* sitio para el '\0' */
+
+    printf("asignador,tamano,hilos,ops,ops_por_seg,rss_kb_delta,regiones_nuevas,"
+           "regiones_eliminadas,regiones_cambiadas,fallos\n");
+    for (i = 0; i < num_tamanos; i++)
+        for (j = 0; j < (int)(sizeof(asignadores) / sizeof(asignadores[0])); j++)
+            for (h = 1; h <= hilos; h = h == hilos ? hilos + 1 : hilos)
+                medir(&asignadores[j], tamanos[i], h, mapas, &lectura, trabajadores);
+
+    mapa_liberar(&mapas[0]);
+    mapa_liberar(&mapas[1]);
+    mapa_liberar(&lectura);
+    return 0;
+}
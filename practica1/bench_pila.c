@@ -0,0 +1,355 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "mapas.h"
+
+/*
+ * Coste de la pila. problema2 pone un vector de 14000 bytes en la pila de
+ * funcion y problema5 mira el mapa desde un hilo; aqui se mide:
+ *
+ *   recursion   en un hilo nuevo (pila sin tocar), una recursion con marcos
+ *               de distintos tamaños: tiempo en frio (con fallos de pagina),
+ *               en caliente y coste medio de cada fallo.
+ *   hilos       N hilos vivos a la vez con cada configuracion de pila:
+ *               pthread_attr_setstacksize, tamaño de la pagina de guarda,
+ *               una pila mmap propia por hilo o un solo bloque mmap para
+ *               todos. Latencia de pthread_create y memoria residente,
+ *               virtual y regiones del mapa por hilo.
+ *
+ * glibc guarda las pilas de los hilos terminados (unos 40 MiB) y las reusa,
+ * asi que tras una medida grande la siguiente puede crear menos regiones.
+ * Cada seccion es CSV con su propia cabecera, separadas por una linea vacia.
+ */
+#define USO "Uso: bench_pila [-m recursion|hilos] [-b MiB por recursion] [-u bytes por hilo] [hilos...]\n"
+#define PILA_RECURSION (64 << 20)
+#define MAX_CUENTAS 16
+#define MAPA_HILOS_TEXTO (4 << 20)      /* miles de hilos: dos regiones por hilo */
+#define MAPA_HILOS_REGIONES 32768
+
+enum tipo_pila { PILA_GLIBC, PILA_MMAP, PILA_BLOQUE };
+
+struct config {
+    const char *nombre;
+    size_t pila;                        /* 0 = la de glibc (RLIMIT_STACK) */
+    size_t guarda;                      /* (size_t)-1 = la de glibc */
+    enum tipo_pila tipo;
+};
+
+static const struct config configs[] = {
+    { "defecto", 0, (size_t)-1, PILA_GLIBC },
+    { "16k", 16 << 10, (size_t)-1, PILA_GLIBC },
+    { "64k", 64 << 10, (size_t)-1, PILA_GLIBC },
+    { "256k", 256 << 10, (size_t)-1, PILA_GLIBC },
+    { "1m", 1 << 20, (size_t)-1, PILA_GLIBC },
+    { "256k_sin_guarda", 256 << 10, 0, PILA_GLIBC },
+    { "256k_guarda_64k", 256 << 10, 64 << 10, PILA_GLIBC },
+    { "256k_mmap_propia", 256 << 10, 4 << 10, PILA_MMAP },
+    { "256k_bloque", 256 << 10, 0, PILA_BLOQUE },
+};
+
+static const size_t marcos[] = { 64, 1024, 14000, 65536, 1 << 20 };
+
+static long pagina;
+static size_t bytes_recursion = 16 << 20;
+static size_t uso_hilo = 8 << 10;
+static int tuberia[2];                  /* al cerrarla el hilo principal, los hilos terminan */
+static int listos;
+
+static double segundos(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long fallos_hilo(void) {
+    struct rusage uso;
+
+    getrusage(RUSAGE_THREAD, &uso);
+    return uso.ru_minflt + uso.ru_majflt;
+}
+
+/* Un marco de "marco" bytes por nivel, escrito pagina a pagina como el vector de problema2. */
+static __attribute__((noinline)) long bajar(int nivel, size_t marco) {
+    volatile char vector[marco];
+    size_t i;
+
+    for (i = 0; i < marco; i += pagina)
+        vector[i] = (char)nivel;
+    vector[marco - 1] = (char)nivel;
+    if (!nivel)
+        return vector[0];
+    return bajar(nivel - 1, marco) + vector[marco - 1];
+}
+
+struct recursion {
+    size_t marco;
+    int profundidad;
+    double frio, caliente;
+    long fallos;
+};
+
+static void *hilo_recursion(void *arg) {
+    struct recursion *r = arg;
+    double inicio;
+    long fallos;
+
+    fallos = fallos_hilo();
+    inicio = segundos();
+    bajar(r->profundidad, r->marco);
+    r->frio = segundos() - inicio;
+    r->fallos = fallos_hilo() - fallos;
+
+    inicio = segundos();
+    bajar(r->profundidad, r->marco);
+    r->caliente = segundos() - inicio;
+    return NULL;
+}
+
+static void medir_recursion(void) {
+    pthread_attr_t attr;
+    pthread_t id;
+    struct recursion r;
+    size_t i;
+
+    printf("marco,profundidad,mib,frio_us,caliente_us,fallos,us_por_fallo\n");
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, PILA_RECURSION);
+    for (i = 0; i < sizeof(marcos) / sizeof(marcos[0]); i++) {
+        memset(&r, 0, sizeof(r));
+        r.marco = marcos[i];
+        r.profundidad = bytes_recursion / marcos[i];
+        /* Un hilo nuevo por medida: su pila todavia no tiene paginas. */
+        if (pthread_create(&id, &attr, hilo_recursion, &r)) {
+            fprintf(stderr, "Error al crear el hilo de recursion\n");
+            break;
+        }
+        pthread_join(id, NULL);
+        printf("%zu,%d,%zu,%.1f,%.1f,%ld,%.3f\n", r.marco, r.profundidad, bytes_recursion >> 20,
+               r.frio * 1e6, r.caliente * 1e6, r.fallos,
+               r.fallos ? (r.frio - r.caliente) * 1e6 / r.fallos : 0.0);
+        fflush(stdout);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static void *hilo_dormido(void *arg) {
+    size_t uso = (size_t)arg, i;
+    volatile char vector[uso];
+    char c;
+
+    for (i = 0; i < uso; i += pagina)
+        vector[i] = 1;
+    __atomic_add_fetch(&listos, 1, __ATOMIC_RELEASE);
+    while (read(tuberia[0], &c, 1) > 0)
+        ;
+    return (void *)(long)vector[0];
+}
+
+/* Paginas residentes y virtuales del proceso, de /proc/self/statm. */
+static void memoria(struct mapa *lectura, long *virtual, long *residente) {
+    *virtual = *residente = 0;
+    if (mapa_leer_fichero(lectura, "/proc/self/statm") == -1)
+        return;
+    lectura->texto[lectura->longitud] = '\0';
+    sscanf(lectura->texto, "%ld %ld", virtual, residente);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void medir_hilos(const struct config *c, int hilos, pthread_t *ids, double *creacion,
+                        struct mapa mapas[2], struct mapa *lectura) {
+    size_t pila = c->pila, uso = uso_hilo, ranura;
+    long virtual_antes, residente_antes, virtual_despues, residente_despues;
+    struct diferencias dif;
+    pthread_attr_t attr;
+    char *bloque = NULL, **propias = NULL;
+    double inicio, suma = 0;
+    int creados, i;
+
+    if (!pila) {
+        pthread_attr_init(&attr);
+        pthread_attr_getstacksize(&attr, &pila);
+        pthread_attr_destroy(&attr);
+    }
+    if (uso > pila / 2)
+        uso = pila / 2;                 /* que el hilo no se salga de su pila */
+
+    if (pipe(tuberia)) {
+        perror("pipe");
+        return;
+    }
+    listos = 0;
+    if (c->tipo == PILA_MMAP)
+        propias = calloc(hilos, sizeof(*propias));
+    ranura = c->tipo == PILA_GLIBC ? 0 : c->guarda + pila;
+    memoria(lectura, &virtual_antes, &residente_antes);
+    mapa_leer(&mapas[0], 0);
+
+    if (c->tipo == PILA_BLOQUE) {
+        bloque = mmap(NULL, ranura * hilos, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+        if (bloque == MAP_FAILED) {
+            perror("Error al reservar el bloque de pilas");
+            close(tuberia[0]);
+            close(tuberia[1]);
+            return;
+        }
+    }
+
+    for (creados = 0; creados < hilos; creados++) {
+        inicio = segundos();
+        pthread_attr_init(&attr);
+        if (c->tipo == PILA_GLIBC) {
+            i = pthread_attr_setstacksize(&attr, pila);
+            if (!i && c->guarda != (size_t)-1)
+                i = pthread_attr_setguardsize(&attr, c->guarda);
+        } else if (c->tipo == PILA_MMAP) {
+            /* La guarda de una pila propia la pone quien la reserva. */
+            propias[creados] = mmap(NULL, ranura, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+            if (propias[creados] == MAP_FAILED) {
+                pthread_attr_destroy(&attr);
+                break;
+            }
+            mprotect(propias[creados], c->guarda, PROT_NONE);
+            i = pthread_attr_setstack(&attr, propias[creados] + c->guarda, pila);
+        } else {
+            i = pthread_attr_setstack(&attr, bloque + creados * ranura, pila);
+        }
+        if (i) {
+            /* EINVAL: menos de PTHREAD_STACK_MIN o sin alinear. Con la pila por defecto la fila mentiria. */
+            fprintf(stderr, "%s: pila de %zu KiB: %s\n", c->nombre, pila >> 10, strerror(i));
+            if (c->tipo == PILA_MMAP)
+                munmap(propias[creados], ranura);
+            pthread_attr_destroy(&attr);
+            break;
+        }
+        i = pthread_create(&ids[creados], &attr, hilo_dormido, (void *)uso);
+        pthread_attr_destroy(&attr);
+        creacion[creados] = segundos() - inicio;
+        if (i) {
+            if (c->tipo == PILA_MMAP)
+                munmap(propias[creados], ranura);
+            fprintf(stderr, "%s: solo %d hilos: %s\n", c->nombre, creados, strerror(i));
+            break;
+        }
+        suma += creacion[creados];
+    }
+
+    /* Todos vivos y con su pila escrita: se mide la memoria. */
+    while (__atomic_load_n(&listos, __ATOMIC_ACQUIRE) < creados)
+        usleep(1000);
+    memoria(lectura, &virtual_despues, &residente_despues);
+    mapa_leer(&mapas[1], 0);
+    mapa_contar_diferencias(&mapas[0], &mapas[1], &dif);
+
+    close(tuberia[1]);
+    for (i = 0; i < creados; i++)
+        pthread_join(ids[i], NULL);
+    close(tuberia[0]);
+    if (propias) {
+        for (i = 0; i < creados; i++)
+            munmap(propias[i], ranura);
+        free(propias);
+    }
+    if (bloque)
+        munmap(bloque, ranura * hilos);
+    if (!creados)
+        return;
+
+    qsort(creacion, creados, sizeof(*creacion), cmp_double);
+    printf("%s,%zu,%zu,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.2f\n", c->nombre, pila >> 10,
+           c->guarda == (size_t)-1 ? (size_t)pagina >> 10 : c->guarda >> 10, creados,
+           suma * 1e6 / creados, creacion[(int)(0.99 * (creados - 1))] * 1e6,
+           (double)(residente_despues - residente_antes) * pagina / 1024 / creados,
+           (double)(virtual_despues - virtual_antes) * pagina / 1024 / creados,
+           (double)(dif.nuevas - dif.eliminadas) / creados,
+           (double)dif.cambiadas / creados);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    int cuentas[MAX_CUENTAS] = { 10, 100, 1000, 4000 };
+    int opcion, num_cuentas = 4, recursion = 1, hilos = 1, max_hilos = 0, i, j;
+    struct mapa mapas[2], lectura;
+    double *creacion;
+    pthread_t *ids;
+
+    while ((opcion = getopt(argc, argv, "m:b:u:")) != -1) {
+        switch (opcion) {
+        case 'm':
+            recursion = !strcmp(optarg, "recursion");
+            hilos = !strcmp(optarg, "hilos");
+            if (!recursion && !hilos) {
+                fprintf(stderr, USO);
+                return 1;
+            }
+            break;
+        case 'b':
+            bytes_recursion = (size_t)atol(optarg) << 20;
+            break;
+        case 'u':
+            uso_hilo = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, USO);
+            return 1;
+        }
+    }
+    if (!bytes_recursion || bytes_recursion > PILA_RECURSION / 2 || !uso_hilo) {
+        fprintf(stderr, USO);
+        return 1;
+    }
+    if (optind < argc)
+        for (num_cuentas = 0; optind < argc && num_cuentas < MAX_CUENTAS; optind++)
+            if ((cuentas[num_cuentas] = atoi(argv[optind])) > 0)
+                num_cuentas++;
+    for (i = 0; i < num_cuentas; i++)
+        if (cuentas[i] > max_hilos)
+            max_hilos = cuentas[i];
+    pagina = sysconf(_SC_PAGESIZE);
+
+    if (recursion)
+        medir_recursion();
+    if (!hilos)
+        return 0;
+    if (recursion)
+        printf("\n");
+
+    ids = calloc(max_hilos, sizeof(*ids));
+    creacion = calloc(max_hilos, sizeof(*creacion));
+    if (!ids || !creacion ||
+        mapa_iniciar(&mapas[0], MAPA_HILOS_TEXTO, MAPA_HILOS_REGIONES) ||
+        mapa_iniciar(&mapas[1], MAPA_HILOS_TEXTO, MAPA_HILOS_REGIONES) ||
+        mapa_iniciar(&lectura, 4096, 1)) {
+        perror("Error al reservar las muestras");
+        return 1;
+    }
+    lectura.capacidad--;                /* sitio para el '\0' */
+
+    printf("config,pila_kb,guarda_kb,hilos,creacion_us,creacion_p99_us,rss_kb_por_hilo,"
+           "virtual_kb_por_hilo,regiones_por_hilo,regiones_cambiadas_por_hilo\n");
+    for (i = 0; i < (int)(sizeof(configs) / sizeof(configs[0])); i++)
+        for (j = 0; j < num_cuentas; j++)
+            medir_hilos(&configs[i], cuentas[j], ids, creacion, mapas, &lectura);
+
+    mapa_liberar(&mapas[0]);
+    mapa_liberar(&mapas[1]);
+    mapa_liberar(&lectura);
+    free(ids);
+    free(creacion);
+    return 0;
+}
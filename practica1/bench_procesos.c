@@ -0,0 +1,265 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <spawn.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+/*
+ * Cuanto cuesta crear y esperar un proceso o hilo segun la primitiva y el
+ * tamaño residente del padre. problema6 usa fork, problema5_2 pthreads y
+ * todos los de practica1 usaban system(). Para cada tamaño de heap
+ * (escrito entero, de modo que fork tiene que copiar sus tablas de paginas)
+ * se mide:
+ *
+ *   sin exec    fork, vfork, clone(CLONE_VM) y pthread_create: el hijo sale enseguida
+ *   con exec    fork+exec, vfork+exec y posix_spawn del mismo programa (/bin/true)
+ *
+ * creacion_us es lo que tarda la llamada en volver al padre y ciclo_us
+ * hasta que waitpid/pthread_join termina. Al final se recomienda, para cada
+ * tamaño, la primitiva mas rapida de cada grupo; posix_spawn y pthread_create
+ * ganan si no son mas de un 10% mas lentas, porque vfork y clone(CLONE_VM)
+ * comparten la memoria del padre y el hijo no puede usar casi nada de libc.
+ */
+#define VENTAJA_SEGURA 0.9
+#define USO "Uso: bench_procesos [-n iteraciones] [-p programa] [-H] [MiB...]\n"
+#define PILA_CLONE (64 * 1024)
+#define MAX_SEGUNDOS 2.0                /* por combinacion, aunque no se llegue a -n */
+#define MIN_ITERACIONES 10
+#define MAX_TAMANOS 32
+
+extern char **environ;
+
+struct primitiva {
+    const char *nombre;
+    int exec;
+    int segura;                         /* API que se puede usar sin cuidados especiales */
+    pid_t (*crear)(void);               /* devuelve pid, o 0 para pthread */
+};
+
+struct resultado {
+    double ciclo_us;
+    double puntos;                      /* ciclo_us, rebajado para las primitivas seguras */
+    const char *nombre;
+};
+
+static const char *programa = "/bin/true";
+static char *pila_clone;
+static pthread_t hilo_id;
+
+static double segundos(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static pid_t crear_fork(void) {
+    pid_t pid = fork();
+
+    if (pid == 0)
+        _exit(0);
+    return pid;
+}
+
+static pid_t crear_vfork(void) {
+    pid_t pid = vfork();
+
+    if (pid == 0)
+        _exit(0);
+    return pid;
+}
+
+static int hijo_clone(void *arg) {
+    return 0;
+}
+
+static pid_t crear_clone(void) {
+    return clone(hijo_clone, pila_clone + PILA_CLONE, CLONE_VM | SIGCHLD, NULL);
+}
+
+static void *hilo_vacio(void *arg) {
+    return NULL;
+}
+
+static pid_t crear_pthread(void) {
+    return pthread_create(&hilo_id, NULL, hilo_vacio, NULL) ? -1 : 0;
+}
+
+static pid_t crear_fork_exec(void) {
+    char *argv[] = { (char *)programa, NULL };
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        execve(programa, argv, environ);
+        _exit(127);
+    }
+    return pid;
+}
+
+static pid_t crear_vfork_exec(void) {
+    char *argv[] = { (char *)programa, NULL };
+    pid_t pid = vfork();
+
+    if (pid == 0) {
+        execve(programa, argv, environ);
+        _exit(127);
+    }
+    return pid;
+}
+
+static pid_t crear_posix_spawn(void) {
+    char *argv[] = { (char *)programa, NULL };
+    pid_t pid;
+
+    errno = posix_spawn(&pid, programa, NULL, NULL, argv, environ);
+    return errno ? -1 : pid;
+}
+
+static const struct primitiva primitivas[] = {
+    { "fork", 0, 0, crear_fork },
+    { "vfork", 0, 0, crear_vfork },
+    { "clone_vm", 0, 0, crear_clone },
+    { "pthread_create", 0, 1, crear_pthread },
+    { "fork_exec", 1, 0, crear_fork_exec },
+    { "vfork_exec", 1, 0, crear_vfork_exec },
+    { "posix_spawn", 1, 1, crear_posix_spawn },
+};
+
+#define NUM_PRIMITIVAS (int)(sizeof(primitivas) / sizeof(primitivas[0]))
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Devuelve la mediana del ciclo en microsegundos, o -1 si la primitiva falla. */
+static double medir(const struct primitiva *p, size_t mib, int iteraciones, double *creacion, double *ciclo) {
+    double inicio, creado, fin, total = segundos();
+    int i, estado;
+    pid_t pid;
+
+    for (i = 0; i < iteraciones; i++) {
+        if (i >= MIN_ITERACIONES && segundos() - total > MAX_SEGUNDOS)
+            break;
+        inicio = segundos();
+        pid = p->crear();
+        creado = segundos();
+        if (pid == -1) {
+            perror(p->nombre);
+            return -1;
+        }
+        if (pid)
+            waitpid(pid, &estado, 0);
+        else
+            pthread_join(hilo_id, NULL);
+        fin = segundos();
+        if (pid && (!WIFEXITED(estado) || WEXITSTATUS(estado))) {
+            fprintf(stderr, "%s: el hijo ha fallado\n", p->nombre);
+            return -1;
+        }
+        creacion[i] = (creado - inicio) * 1e6;
+        ciclo[i] = (fin - inicio) * 1e6;
+    }
+
+    qsort(creacion, i, sizeof(*creacion), cmp_double);
+    qsort(ciclo, i, sizeof(*ciclo), cmp_double);
+    printf("%s,%zu,%d,%.1f,%.1f,%.1f,%.0f\n", p->nombre, mib, i, creacion[i / 2], ciclo[i / 2],
+           ciclo[(int)(0.99 * (i - 1))], i / (fin - total));
+    fflush(stdout);
+    return ciclo[i / 2];
+}
+
+int main(int argc, char *argv[]) {
+    size_t tamanos[MAX_TAMANOS] = { 0, 16, 256, 1024 };
+    struct resultado mejor[2];
+    double *creacion, *ciclo, us, puntos;
+    char *heap;
+    int opcion, iteraciones = 1000, num_tamanos = 4, huge = 0, i, j;
+
+    while ((opcion = getopt(argc, argv, "n:p:H")) != -1) {
+        switch (opcion) {
+        case 'n':
+            iteraciones = atoi(optarg);
+            break;
+        case 'p':
+            programa = optarg;
+            break;
+        case 'H':
+            huge = 1;
+            break;
+        default:
+            fprintf(stderr, USO);
+            return 1;
+        }
+    }
+    if (iteraciones < 1) {
+        fprintf(stderr, USO);
+        return 1;
+    }
+    if (optind < argc)
+        for (num_tamanos = 0; optind < argc && num_tamanos < MAX_TAMANOS; optind++)
+            tamanos[num_tamanos++] = strtoul(argv[optind], NULL, 10);
+
+    creacion = calloc(iteraciones, sizeof(*creacion));
+    ciclo = calloc(iteraciones, sizeof(*ciclo));
+    pila_clone = mmap(NULL, PILA_CLONE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (!creacion || !ciclo || pila_clone == MAP_FAILED) {
+        perror("Error al reservar las muestras");
+        return 1;
+    }
+
+    printf("primitiva,heap_mib,iteraciones,creacion_us,ciclo_us,ciclo_p99_us,ops_por_seg\n");
+    for (i = 0; i < num_tamanos; i++) {
+        heap = NULL;
+        if (tamanos[i]) {
+            heap = mmap(NULL, tamanos[i] << 20, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (heap == MAP_FAILED) {
+                perror("Error al reservar el heap");
+                return 1;
+            }
+            /* Con paginas de 4 KiB hay una entrada de tabla por pagina: el caso de un heap de malloc. */
+            if (!huge)
+                madvise(heap, tamanos[i] << 20, MADV_NOHUGEPAGE);
+            memset(heap, 1, tamanos[i] << 20);
+        }
+
+        mejor[0].ciclo_us = mejor[1].ciclo_us = -1;
+        for (j = 0; j < NUM_PRIMITIVAS; j++) {
+            struct resultado *r = &mejor[primitivas[j].exec];
+
+            us = medir(&primitivas[j], tamanos[i], iteraciones, creacion, ciclo);
+            if (us < 0)
+                continue;
+            puntos = primitivas[j].segura ? us * VENTAJA_SEGURA : us;
+            if (r->ciclo_us < 0 || puntos < r->puntos) {
+                r->ciclo_us = us;
+                r->puntos = puntos;
+                r->nombre = primitivas[j].nombre;
+            }
+        }
+        if (mejor[1].ciclo_us >= 0)
+            fprintf(stderr, "Con %zu MiB de heap, para lanzar programas: %s (%.1f us)",
+                    tamanos[i], mejor[1].nombre, mejor[1].ciclo_us);
+        if (mejor[0].ciclo_us >= 0)
+            fprintf(stderr, "; para trabajo en el mismo programa: %s (%.1f us)",
+                    mejor[0].nombre, mejor[0].ciclo_us);
+        fprintf(stderr, "\n");
+
+        if (heap)
+            munmap(heap, tamanos[i] << 20);
+    }
+
+    munmap(pila_clone, PILA_CLONE);
+    free(creacion);
+    free(ciclo);
+    return 0;
+}
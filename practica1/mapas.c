@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mapas.h"
+
+int mapa_iniciar(struct mapa *mapa, size_t capacidad, size_t max_regiones) {
+    memset(mapa, 0, sizeof(*mapa));
+    mapa->texto = malloc(capacidad);
+    mapa->regiones = calloc(max_regiones, sizeof(*mapa->regiones));
+    if (!mapa->texto || !mapa->regiones) {
+        mapa_liberar(mapa);
+        errno = ENOMEM;
+        return -1;
+    }
+    /* Tocar las paginas ahora para que la primera lectura no provoque fallos. */
+    memset(mapa->texto, 0, capacidad);
+    mapa->capacidad = capacidad;
+    mapa->max_regiones = max_regiones;
+    return 0;
+}
+
+void mapa_liberar(struct mapa *mapa) {
+    free(mapa->texto);
+    free(mapa->regiones);
+    memset(mapa, 0, sizeof(*mapa));
+}
+
+/* Salta un campo y los espacios que le siguen. */
+static const char *siguiente_campo(const char *p, const char *fin) {
+    while (p < fin && *p != ' ')
+        p++;
+    while (p < fin && *p == ' ')
+        p++;
+    return p;
+}
+
+static int trocear(struct mapa *mapa) {
+    const char *p = mapa->texto, *fin_texto = mapa->texto + mapa->longitud;
+    const char *fin_linea, *campo;
+    struct region *region;
+    char *resto;
+
+    mapa->num_regiones = 0;
+    while (p < fin_texto) {
+        fin_linea = memchr(p, '\n', fin_texto - p);
+        if (!fin_linea)
+            fin_linea = fin_texto;
+        if (mapa->num_regiones == mapa->max_regiones) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        region = &mapa->regiones[mapa->num_regiones++];
+        region->linea = p;
+        region->longitud_linea = fin_linea - p;
+
+        region->inicio = strtoul(p, &resto, 16);
+        region->fin = strtoul(resto + 1, &resto, 16);
+        memcpy(region->permisos, resto + 1, 4);
+        region->permisos[4] = '\0';
+
+        /* permisos, offset, dispositivo e inodo */
+        campo = siguiente_campo(resto + 1, fin_linea);
+        campo = siguiente_campo(campo, fin_linea);
+        campo = siguiente_campo(campo, fin_linea);
+        campo = siguiente_campo(campo, fin_linea);
+        region->nombre = campo;
+        region->longitud_nombre = fin_linea - campo;
+
+        p = fin_linea + 1;
+    }
+    return 0;
+}
+
+ssize_t mapa_leer_fichero(struct mapa *mapa, const char *ruta) {
+    ssize_t leidos;
+    int fd;
+
+    fd = open(ruta, O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    /* seq_file llena todo el buffer que se le da: normalmente basta una lectura. */
+    mapa->longitud = 0;
+    while ((leidos = read(fd, mapa->texto + mapa->longitud, mapa->capacidad - mapa->longitud)) > 0) {
+        mapa->longitud += leidos;
+        if (mapa->longitud == mapa->capacidad) {
+            close(fd);
+            errno = ENOBUFS;
+            return -1;
+        }
+    }
+    close(fd);
+    if (leidos == -1)
+        return -1;
+    return mapa->longitud;
+}
+
+int mapa_leer(struct mapa *mapa, pid_t pid) {
+    char ruta[32];
+
+    if (pid)
+        snprintf(ruta, sizeof(ruta), "/proc/%d/maps", (int)pid);
+    else
+        strcpy(ruta, "/proc/self/maps");
+    if (mapa_leer_fichero(mapa, ruta) == -1)
+        return -1;
+    return trocear(mapa);
+}
+
+void mapa_imprimir(const struct mapa *mapa) {
+    fwrite(mapa->texto, 1, mapa->longitud, stdout);
+}
+
+int mapa_mostrar(struct mapa *mapa, const struct mapa *anterior) {
+    if (mapa_leer(mapa, 0)) {
+        perror("/proc/self/maps");
+        return -1;
+    }
+    mapa_imprimir(mapa);
+    if (anterior) {
+        printf("Cambios respecto al mapa anterior:\n");
+        if (!mapa_diferencias(anterior, mapa))
+            printf("  ninguno\n");
+    }
+    return 0;
+}
+
+static int misma_region(const struct region *a, const struct region *b) {
+    /* El heap crece por el final y la pila por el principio. */
+    return (a->inicio == b->inicio || a->fin == b->fin) &&
+           !strcmp(a->permisos, b->permisos) &&
+           a->longitud_nombre == b->longitud_nombre &&
+           !memcmp(a->nombre, b->nombre, a->longitud_nombre);
+}
+
+static void imprimir_cambio(char signo, const struct region *region, const struct region *anterior) {
+    printf("%c %012lx-%012lx %s %8lu kB", signo, region->inicio, region->fin, region->permisos,
+           (region->fin - region->inicio) / 1024);
+    if (anterior)
+        printf(" (antes %lu kB)", (anterior->fin - anterior->inicio) / 1024);
+    if (region->longitud_nombre)
+        printf(" %.*s\n", region->longitud_nombre, region->nombre);
+    else
+        printf(" [anonima]\n");
+}
+
+/* Recorre los dos mapas a la vez; imprime cada cambio si se pide. */
+static void comparar(const struct mapa *antes, const struct mapa *despues, int imprimir,
+                     struct diferencias *dif) {
+    const struct region *a = antes->regiones, *b = despues->regiones;
+    size_t i = 0, j = 0;
+
+    memset(dif, 0, sizeof(*dif));
+    /* Las dos listas vienen ordenadas por direccion. */
+    while (i < antes->num_regiones || j < despues->num_regiones) {
+        if (i < antes->num_regiones && j < despues->num_regiones && misma_region(&a[i], &b[j])) {
+            if (a[i].inicio != b[j].inicio || a[i].fin != b[j].fin) {
+                if (imprimir)
+                    imprimir_cambio('~', &b[j], &a[i]);
+                dif->cambiadas++;
+            }
+            i++;
+            j++;
+        } else if (j == despues->num_regiones || (i < antes->num_regiones && a[i].inicio < b[j].inicio)) {
+            if (imprimir)
+                imprimir_cambio('-', &a[i], NULL);
+            dif->eliminadas++;
+            i++;
+        } else {
+            if (imprimir)
+                imprimir_cambio('+', &b[j], NULL);
+            dif->nuevas++;
+            j++;
+        }
+    }
+}
+
+int mapa_diferencias(const struct mapa *antes, const struct mapa *despues) {
+    struct diferencias dif;
+
+    comparar(antes, despues, 1, &dif);
+    return dif.nuevas + dif.eliminadas + dif.cambiadas;
+}
+
+void mapa_contar_diferencias(const struct mapa *antes, const struct mapa *despues, struct diferencias *dif) {
+    comparar(antes, despues, 0, dif);
+}
+
+const struct region *mapa_buscar(const struct mapa *mapa, const void *direccion) {
+    unsigned long d = (unsigned long)direccion;
+    size_t bajo = 0, alto = mapa->num_regiones;
+
+    while (bajo < alto) {
+        size_t medio = (bajo + alto) / 2;
+
+        if (d < mapa->regiones[medio].inicio)
+            alto = medio;
+        else if (d >= mapa->regiones[medio].fin)
+            bajo = medio + 1;
+        else
+            return &mapa->regiones[medio];
+    }
+    return NULL;
+}
+
+void mapa_variable(const struct mapa *mapa, const char *nombre, const void *direccion, size_t tamano) {
+    const struct region *region = mapa_buscar(mapa, direccion);
+
+    printf("%18s %p ", nombre, direccion);
+    if (tamano)
+        printf("%12zu", tamano);
+    else
+        printf("%12s", "");
+    if (region && region->longitud_nombre)
+        printf("  %s %.*s", region->permisos, region->longitud_nombre, region->nombre);
+    else if (region)
+        printf("  %s [anonima]", region->permisos);
+    printf("\n");
+}
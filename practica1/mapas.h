@@ -0,0 +1,69 @@
+#ifndef MAPAS_H
+#define MAPAS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Lectura de /proc/<pid>/maps sin lanzar "cat": el fichero se lee entero en
+ * un buffer reservado de antemano y se trocea en regiones sin volver a pedir
+ * memoria, para no alterar el mapa que se esta midiendo.
+ */
+
+#define MAPA_CAPACIDAD (256 * 1024)
+#define MAPA_MAX_REGIONES 4096
+
+struct region {
+    unsigned long inicio;
+    unsigned long fin;
+    char permisos[5];
+    const char *linea;          /* linea original dentro del buffer, sin '\n' */
+    int longitud_linea;
+    const char *nombre;         /* ruta, [heap], [stack]... o "" si es anonima */
+    int longitud_nombre;
+};
+
+struct mapa {
+    char *texto;
+    size_t capacidad;
+    size_t longitud;
+    struct region *regiones;
+    size_t num_regiones;
+    size_t max_regiones;
+};
+
+/* Reserva el buffer y la tabla de regiones; hacerlo antes de la primera medida. */
+int mapa_iniciar(struct mapa *mapa, size_t capacidad, size_t max_regiones);
+void mapa_liberar(struct mapa *mapa);
+
+/* Lee cualquier fichero de /proc en el buffer del mapa, sin trocearlo. Devuelve la longitud. */
+ssize_t mapa_leer_fichero(struct mapa *mapa, const char *ruta);
+
+/* Lee el mapa del proceso pid (0 = el propio). -1 y errno si falla o no cabe. */
+int mapa_leer(struct mapa *mapa, pid_t pid);
+
+/* Igual que "cat /proc/<pid>/maps". */
+void mapa_imprimir(const struct mapa *mapa);
+
+/* Lee el mapa propio, lo imprime y, si se da uno anterior, muestra los cambios. */
+int mapa_mostrar(struct mapa *mapa, const struct mapa *anterior);
+
+/* Regiones nuevas (+), eliminadas (-) y que cambian de tamaño (~). Devuelve cuantas. */
+int mapa_diferencias(const struct mapa *antes, const struct mapa *despues);
+
+struct diferencias {
+    int nuevas;
+    int eliminadas;
+    int cambiadas;
+};
+
+/* Lo mismo sin imprimir nada, para medir muchas veces. */
+void mapa_contar_diferencias(const struct mapa *antes, const struct mapa *despues, struct diferencias *dif);
+
+/* Region que contiene la direccion, o NULL. */
+const struct region *mapa_buscar(const struct mapa *mapa, const void *direccion);
+
+/* Una fila de la tabla "Variable / funcion Direccion Tamaño"; tamano 0 para funciones. */
+void mapa_variable(const struct mapa *mapa, const char *nombre, const void *direccion, size_t tamano);
+
+#endif
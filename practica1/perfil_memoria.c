@@ -0,0 +1,353 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include "mapas.h"
+
+/*
+ * Perfil de memoria de un proceso y sus hijos (como problema6) o de sus
+ * hilos (como problema5). El padre reserva y escribe un buffer; despues
+ * cada hijo o hilo va escribiendo en una parte de el. Cada intervalo se
+ * toma una muestra de:
+ *
+ *   /proc/<pid>/smaps_rollup         RSS, PSS y paginas compartidas/privadas
+ *   /proc/<pid>/smaps                RSS y PSS de la region observada
+ *   /proc/<pid>/pagemap              paginas presentes y exclusivas de la region
+ *   /proc/<pid>[/task/<tid>]/stat    fallos de pagina menores y mayores
+ *
+ * La region observada es el buffer en los procesos y la pila de cada hilo
+ * en los hilos (pagemap: el trozo del buffer que escribe ese hilo). Tras un
+ * fork, las paginas del buffer que dejan de ser compartidas son las que ha
+ * copiado el copy-on-write. La salida es CSV, una fila por muestra y tarea.
+ */
+#define USO "Uso: perfil_memoria [-m fork|hilos] [-n tareas] [-s MiB] [-e %%escritura] [-i ms] [-k muestras]\n"
+#define MAX_TAREAS 256
+#define PILA_HILO (256 * 1024)          /* lo que escribe cada hilo en su pila */
+#define ARENA (4 << 20)                 /* smaps con cientos de hilos no cabe en MAPA_CAPACIDAD */
+#define PAGEMAP_PRESENTE (1ULL << 63)
+#define PAGEMAP_EXCLUSIVA (1ULL << 56)
+
+struct opciones {
+    int hilos;
+    int tareas;
+    size_t tamano;
+    int escritura;
+    int intervalo_ms;
+    int muestras;
+};
+
+struct tarea {
+    pid_t pid;                          /* pid del hijo o tid del hilo */
+    char *trozo;                        /* parte del buffer que escribe */
+    size_t tamano_trozo;
+    const void *pila;                   /* solo hilos */
+    int listo;
+};
+
+struct muestra {
+    long rss, pss, shared_clean, shared_dirty, private_clean, private_dirty;
+    long region_rss, region_pss;
+    long presentes, exclusivas;
+    unsigned long minflt, majflt;
+};
+
+static struct opciones op = { 0, 2, 64 << 20, 50, 100, 20 };
+static struct tarea tareas[MAX_TAREAS];
+static char *buffer;
+static long pagina;
+static int tuberia[2];                  /* al cerrarla el padre, las tareas terminan */
+static struct mapa arena;               /* buffer de lectura de /proc, reservado al principio */
+
+static long valor_kb(const char *texto, const char *clave) {
+    const char *p = strstr(texto, clave);
+
+    return p ? strtol(p + strlen(clave), NULL, 10) : 0;
+}
+
+static int leer_rollup(pid_t pid, struct muestra *m) {
+    char ruta[64];
+
+    snprintf(ruta, sizeof(ruta), "/proc/%d/smaps_rollup", (int)pid);
+    if (mapa_leer_fichero(&arena, ruta) == -1)
+        return -1;
+    arena.texto[arena.longitud] = '\0';
+    m->rss = valor_kb(arena.texto, "\nRss:");
+    m->pss = valor_kb(arena.texto, "\nPss:");
+    m->shared_clean = valor_kb(arena.texto, "\nShared_Clean:");
+    m->shared_dirty = valor_kb(arena.texto, "\nShared_Dirty:");
+    m->private_clean = valor_kb(arena.texto, "\nPrivate_Clean:");
+    m->private_dirty = valor_kb(arena.texto, "\nPrivate_Dirty:");
+    return 0;
+}
+
+/* RSS y PSS de la entrada de smaps que contiene la direccion. */
+static int leer_region(pid_t pid, const void *direccion, struct muestra *m) {
+    unsigned long d = (unsigned long)direccion, inicio, fin;
+    char ruta[64], *linea, *siguiente;
+
+    snprintf(ruta, sizeof(ruta), "/proc/%d/smaps", (int)pid);
+    if (mapa_leer_fichero(&arena, ruta) == -1)
+        return -1;
+    arena.texto[arena.longitud] = '\0';
+
+    for (linea = arena.texto; *linea; linea = siguiente) {
+        siguiente = strchr(linea, '\n');
+        siguiente = siguiente ? siguiente + 1 : linea + strlen(linea);
+        /* Las cabeceras de cada region son lineas de maps: "inicio-fin ..." */
+        if (sscanf(linea, "%lx-%lx ", &inicio, &fin) != 2 || d < inicio || d >= fin)
+            continue;
+        m->region_rss = valor_kb(siguiente, "\nRss:");
+        m->region_pss = valor_kb(siguiente, "\nPss:");
+        return 0;
+    }
+    return -1;
+}
+
+/* Paginas presentes y exclusivas (no compartidas con otro proceso) del rango. */
+static int leer_pagemap(pid_t pid, const char *inicio, size_t tamano, struct muestra *m) {
+    static uint64_t entradas[4096];
+    size_t pagina_inicial = (uintptr_t)inicio / pagina, total = tamano / pagina, hechas = 0, n, i;
+    char ruta[64];
+    ssize_t leidos;
+    int fd;
+
+    snprintf(ruta, sizeof(ruta), "/proc/%d/pagemap", (int)pid);
+    fd = open(ruta, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    while (hechas < total) {
+        n = total - hechas < 4096 ? total - hechas : 4096;
+        leidos = pread(fd, entradas, n * sizeof(uint64_t), (pagina_inicial + hechas) * sizeof(uint64_t));
+        if (leidos <= 0)
+            break;
+        n = leidos / sizeof(uint64_t);
+        for (i = 0; i < n; i++) {
+            if (entradas[i] & PAGEMAP_PRESENTE)
+                m->presentes++;
+            if (entradas[i] & PAGEMAP_EXCLUSIVA)
+                m->exclusivas++;
+        }
+        hechas += n;
+    }
+    close(fd);
+    return 0;
+}
+
+/* Campos 10 (minflt) y 12 (majflt) de stat; el nombre puede tener espacios. */
+static int leer_fallos(pid_t pid, pid_t tid, struct muestra *m) {
+    char ruta[64], *p;
+
+    if (tid)
+        snprintf(ruta, sizeof(ruta), "/proc/%d/task/%d/stat", (int)pid, (int)tid);
+    else
+        snprintf(ruta, sizeof(ruta), "/proc/%d/stat", (int)pid);
+    if (mapa_leer_fichero(&arena, ruta) == -1)
+        return -1;
+    arena.texto[arena.longitud] = '\0';
+    p = strrchr(arena.texto, ')');
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %lu %*u %lu", &m->minflt, &m->majflt) != 2)
+        return -1;
+    return 0;
+}
+
+static void imprimir(long t, const char *tarea, pid_t pid, const struct muestra *m) {
+    printf("%ld,%s,%d,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%lu,%lu\n", t, tarea, (int)pid,
+           m->rss, m->pss, m->shared_clean, m->shared_dirty, m->private_clean, m->private_dirty,
+           m->region_rss, m->region_pss, m->presentes, m->exclusivas, m->minflt, m->majflt);
+}
+
+static long ms_desde(const struct timespec *inicio) {
+    struct timespec ahora;
+
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    return (ahora.tv_sec - inicio->tv_sec) * 1000 + (ahora.tv_nsec - inicio->tv_nsec) / 1000000;
+}
+
+static void dormir_ms(int ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+
+    nanosleep(&ts, NULL);
+}
+
+/* Escribe el trozo poco a poco, una parte por intervalo, y espera al padre. */
+static void trabajar(struct tarea *t, char *pila) {
+    size_t paso = (t->tamano_trozo / op.muestras + pagina - 1) / pagina * pagina;
+    size_t hecho = 0, pila_hecha = 0;
+    char c;
+    int k;
+
+    __atomic_store_n(&t->listo, 1, __ATOMIC_RELEASE);
+    for (k = 0; k < op.muestras; k++) {
+        for (; hecho < t->tamano_trozo && hecho < (k + 1) * paso; hecho += pagina)
+            t->trozo[hecho] = (char)k;
+        if (pila)
+            for (; pila_hecha < PILA_HILO && pila_hecha < (k + 1) * (PILA_HILO / op.muestras); pila_hecha += pagina)
+                pila[pila_hecha] = (char)k;
+        dormir_ms(op.intervalo_ms);
+    }
+    while (read(tuberia[0], &c, 1) > 0)
+        ;
+}
+
+static void *hilo(void *arg) {
+    struct tarea *t = arg;
+    volatile char pila[PILA_HILO];
+
+    t->pila = (const void *)pila;
+    t->pid = syscall(SYS_gettid);
+    trabajar(t, (char *)pila);
+    return NULL;
+}
+
+static void muestrear(const struct timespec *inicio) {
+    struct muestra m;
+    char nombre[32];
+    long t = ms_desde(inicio);
+    int i;
+
+    memset(&m, 0, sizeof(m));
+    leer_rollup(getpid(), &m);
+    leer_region(getpid(), buffer, &m);
+    leer_pagemap(getpid(), buffer, op.tamano, &m);
+    leer_fallos(getpid(), 0, &m);
+    imprimir(t, "padre", getpid(), &m);
+
+    for (i = 0; i < op.tareas; i++) {
+        memset(&m, 0, sizeof(m));
+        if (op.hilos) {
+            /* Los hilos comparten RSS/PSS con el padre: solo su pila y sus fallos son suyos. */
+            leer_rollup(getpid(), &m);
+            leer_region(getpid(), tareas[i].pila, &m);
+            leer_pagemap(getpid(), tareas[i].trozo, tareas[i].tamano_trozo, &m);
+            leer_fallos(getpid(), tareas[i].pid, &m);
+            snprintf(nombre, sizeof(nombre), "hilo%d", i);
+        } else {
+            leer_rollup(tareas[i].pid, &m);
+            leer_region(tareas[i].pid, buffer, &m);
+            leer_pagemap(tareas[i].pid, buffer, op.tamano, &m);
+            leer_fallos(tareas[i].pid, 0, &m);
+            snprintf(nombre, sizeof(nombre), "hijo%d", i);
+        }
+        imprimir(t, nombre, tareas[i].pid, &m);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    pthread_t hilos[MAX_TAREAS];
+    struct timespec inicio;
+    size_t trozo;
+    int opcion, i, k;
+
+    while ((opcion = getopt(argc, argv, "m:n:s:e:i:k:")) != -1) {
+        switch (opcion) {
+        case 'm':
+            op.hilos = !strcmp(optarg, "hilos");
+            if (!op.hilos && strcmp(optarg, "fork")) {
+                fprintf(stderr, USO);
+                return 1;
+            }
+            break;
+        case 'n':
+            op.tareas = atoi(optarg);
+            break;
+        case 's':
+            op.tamano = (size_t)atol(optarg) << 20;
+            break;
+        case 'e':
+            op.escritura = atoi(optarg);
+            break;
+        case 'i':
+            op.intervalo_ms = atoi(optarg);
+            break;
+        case 'k':
+            op.muestras = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, USO);
+            return 1;
+        }
+    }
+    if (op.tareas < 1 || op.tareas > MAX_TAREAS || !op.tamano || op.escritura < 0 ||
+        op.escritura > 100 || op.intervalo_ms < 1 || op.muestras < 1) {
+        fprintf(stderr, USO);
+        return 1;
+    }
+
+    pagina = sysconf(_SC_PAGESIZE);
+    if (mapa_iniciar(&arena, ARENA, 1) || pipe(tuberia)) {
+        perror("Error al preparar el perfil");
+        return 1;
+    }
+    arena.capacidad--;                  /* sitio para el '\0' */
+    buffer = mmap(NULL, op.tamano, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+        perror("Error al reservar el buffer");
+        return 1;
+    }
+    memset(buffer, 1, op.tamano);       /* todo privado y sucio antes del fork */
+
+    /* Los hilos escriben trozos distintos; los hijos, el mismo principio del buffer. */
+    trozo = op.tamano * op.escritura / 100;
+    if (op.hilos)
+        trozo /= op.tareas;
+    trozo = trozo / pagina * pagina;
+
+    printf("t_ms,tarea,pid,rss_kb,pss_kb,shared_clean_kb,shared_dirty_kb,private_clean_kb,"
+           "private_dirty_kb,region_rss_kb,region_pss_kb,region_presentes,region_exclusivas,minflt,majflt\n");
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+
+    for (i = 0; i < op.tareas; i++) {
+        tareas[i].trozo = op.hilos ? buffer + i * trozo : buffer;
+        tareas[i].tamano_trozo = trozo;
+        if (op.hilos) {
+            if (pthread_create(&hilos[i], NULL, hilo, &tareas[i])) {
+                fprintf(stderr, "Error al crear el hilo %d\n", i);
+                return 1;
+            }
+            continue;
+        }
+        tareas[i].pid = fork();
+        if (tareas[i].pid == -1) {
+            perror("fork");
+            return 1;
+        }
+        if (tareas[i].pid == 0) {
+            close(tuberia[1]);
+            trabajar(&tareas[i], NULL);
+            _exit(0);
+        }
+    }
+    if (!op.hilos)
+        close(tuberia[0]);
+    if (op.hilos)
+        for (i = 0; i < op.tareas; i++)
+            while (!__atomic_load_n(&tareas[i].listo, __ATOMIC_ACQUIRE))
+                dormir_ms(1);
+
+    for (k = 0; k <= op.muestras; k++) {
+        muestrear(&inicio);
+        dormir_ms(op.intervalo_ms);
+    }
+
+    close(tuberia[1]);
+    for (i = 0; i < op.tareas; i++) {
+        if (op.hilos)
+            pthread_join(hilos[i], NULL);
+        else
+            waitpid(tareas[i].pid, NULL, 0);
+    }
+    munmap(buffer, op.tamano);
+    mapa_liberar(&arena);
+    return 0;
+}
@@ -2,6 +2,7 @@
 # include <unistd.h>
 # include <stdlib.h>
 # include <errno.h>
+# include "mapas.h"
 const int constante = 33;
 int a;
 char b;
@@ -12,33 +13,34 @@ char f[10];
 int g[10]= {0,1,2,3,4,5,6,7,8,9};
 char h[10] = {'a','b','c','d','e','f','g','h','i','j'};
 int main(){
-char cmd[25];
+struct mapa mapa;
 int i;
 static char j;
 int k = 33;
 static char l='B';
 int m[10];
 int n[10] = {0 ,1 ,2 ,3 ,4 ,5 ,6 ,7 ,8 ,9};
-sprintf(cmd,"cat /proc/%d/maps", getpid());
-system(cmd);
+if (mapa_iniciar(&mapa, MAPA_CAPACIDAD, MAPA_MAX_REGIONES) || mapa_mostrar(&mapa, NULL))
+    return 1;
 printf ("--\n") ;
 printf ("Variable / funcion Direccion Tamano\n") ;
-printf ("              main %p\n", main ) ;
-printf ("             errno %p %12ld\n", &errno, sizeof(errno));
-printf ("         constante %p %12ld\n", &constante ,sizeof(constante));
-printf ("                 a %p %12ld\n", &a, sizeof (a));
-printf ("                 b %p %12ld\n", &b, sizeof (b));
-printf ("                 c %p %12ld\n", &c, sizeof (c));
-printf ("                 d %p %12ld\n", &d, sizeof (d));
-printf ("                 e %p %12ld\n", &e, sizeof (e));
-printf ("                 f %p %12ld\n", &f, sizeof (f));
-printf ("                 g %p %12ld\n", &g, sizeof (g));
-printf ("                 h %p %12ld\n", &h, sizeof (h));
-printf ("                 i %p %12ld\n", &i, sizeof (i));
-printf ("                 j %p %12ld\n", &j, sizeof (j));
-printf ("                 k %p %12ld\n", &k, sizeof (k));
-printf ("                 l %p %12ld\n", &l, sizeof (l));
-printf ("                 m %p %12ld\n", &m, sizeof (m));
-printf ("                 n %p %12ld\n", &n, sizeof (n));
+mapa_variable(&mapa, "main", main, 0);
+mapa_variable(&mapa, "errno", &errno, sizeof(errno));
+mapa_variable(&mapa, "constante", &constante, sizeof(constante));
+mapa_variable(&mapa, "a", &a, sizeof(a));
+mapa_variable(&mapa, "b", &b, sizeof(b));
+mapa_variable(&mapa, "c", &c, sizeof(c));
+mapa_variable(&mapa, "d", &d, sizeof(d));
+mapa_variable(&mapa, "e", &e, sizeof(e));
+mapa_variable(&mapa, "f", &f, sizeof(f));
+mapa_variable(&mapa, "g", &g, sizeof(g));
+mapa_variable(&mapa, "h", &h, sizeof(h));
+mapa_variable(&mapa, "i", &i, sizeof(i));
+mapa_variable(&mapa, "j", &j, sizeof(j));
+mapa_variable(&mapa, "k", &k, sizeof(k));
+mapa_variable(&mapa, "l", &l, sizeof(l));
+mapa_variable(&mapa, "m", &m, sizeof(m));
+mapa_variable(&mapa, "n", &n, sizeof(n));
+mapa_liberar(&mapa);
 return 0;
 }
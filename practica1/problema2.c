@@ -2,37 +2,40 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
+#include "mapas.h"
 
 void funcion();
 
+/* Reservados antes de la primera medida para no alterar el mapa. */
+struct mapa mapa[3];
+
 int main(){
-    char cmd[25];
-    sprintf(cmd,"cat /proc/%d/maps",getpid());
-    system(cmd);
+    if (mapa_iniciar(&mapa[0], MAPA_CAPACIDAD, MAPA_MAX_REGIONES) ||
+        mapa_iniciar(&mapa[1], MAPA_CAPACIDAD, MAPA_MAX_REGIONES) ||
+        mapa_iniciar(&mapa[2], MAPA_CAPACIDAD, MAPA_MAX_REGIONES))
+        return 1;
+    mapa_mostrar(&mapa[0], NULL);
     printf ("--\n") ;
-    printf ("              main %p\n", main);
-    printf ("           funcion %p\n", funcion);
+    mapa_variable(&mapa[0], "main", main, 0);
+    mapa_variable(&mapa[0], "funcion", funcion, 0);
     printf ("--\n") ;
     funcion();
     printf ("--\n") ;
-    sprintf(cmd,"cat /proc/%d/maps",getpid());
-    system(cmd);
+    mapa_mostrar(&mapa[2], &mapa[1]);
     printf ("--\n") ;
-    printf ("              main %p\n", main);
-    printf ("           funcion %p\n", funcion);
+    mapa_variable(&mapa[2], "main", main, 0);
+    mapa_variable(&mapa[2], "funcion", funcion, 0);
     return 0;
 
 
 }
 void funcion(){
-    char cmd[25];
     char vector[14000];
-    sprintf(cmd,"cat /proc/%d/maps",getpid());
-    system(cmd);
+    mapa_mostrar(&mapa[1], &mapa[0]);
     printf("--\n") ;
     printf ("Variable / funcion Direccion Tamano\n") ;
-    printf("             vector %p %12ld \n",&vector,sizeof(vector));
-    printf("               main %p\n", main);
-    printf("            funcion %p\n", funcion);
+    mapa_variable(&mapa[1], "vector", &vector, sizeof(vector));
+    mapa_variable(&mapa[1], "main", main, 0);
+    mapa_variable(&mapa[1], "funcion", funcion, 0);
 
-}
\ No newline at end of file
+}
@@ -2,34 +2,37 @@
 # include <unistd.h>
 # include <stdlib.h>
 # include <errno.h>
+# include "mapas.h"
 int main(){
-    char cmd[25];
-    sprintf(cmd,"cat /proc/%d/maps",getpid());
-    system(cmd);
+    struct mapa mapa[3];
+    if (mapa_iniciar(&mapa[0], MAPA_CAPACIDAD, MAPA_MAX_REGIONES) ||
+        mapa_iniciar(&mapa[1], MAPA_CAPACIDAD, MAPA_MAX_REGIONES) ||
+        mapa_iniciar(&mapa[2], MAPA_CAPACIDAD, MAPA_MAX_REGIONES))
+        return 1;
+    mapa_mostrar(&mapa[0], NULL);
     printf("--\n") ;
     printf("Variable / funcion Direccion                 Tamano\n") ;
-    printf("              main %p\n", main);
+    mapa_variable(&mapa[0], "main", main, 0);
     printf("--\n") ;
 
     char *var;
     var = (char *)malloc(14000 * sizeof(char));
 
-    sprintf(cmd,"cat /proc/%d/maps",getpid());
-    system(cmd);
+    mapa_mostrar(&mapa[1], &mapa[0]);
     printf("--\n") ;
     printf("Variable / funcion Direccion                 Tamano\n") ;
-    printf("              main %p\n", main);
-    printf("               var %p %12ld\n", &var, sizeof (var));
+    mapa_variable(&mapa[1], "main", main, 0);
+    mapa_variable(&mapa[1], "var", &var, sizeof(var));
+    mapa_variable(&mapa[1], "*var", var, 14000 * sizeof(char));
     printf("--\n") ;
 
     free(var);
 
-    sprintf(cmd,"cat /proc/%d/maps",getpid());
-    system(cmd);
+    mapa_mostrar(&mapa[2], &mapa[1]);
     printf("--\n") ;
     printf("Variable / funcion Direccion                 Tamano\n") ;
-    printf("              main %p\n", main);
-    printf("               var %p %12ld\n", &var, sizeof (var));
+    mapa_variable(&mapa[2], "main", main, 0);
+    mapa_variable(&mapa[2], "var", &var, sizeof(var));
     printf("--\n") ;
 
     return 0;
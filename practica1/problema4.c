@@ -3,19 +3,22 @@
 # include <stdlib.h>
 # include <errno.h>
 #include <math.h>
+#include "mapas.h"
 
 int main(){
 
     double numero=0.0;
     double resultado=cos(numero);
-    char cmd[25];
-    sprintf(cmd,"cat /proc/%d/maps",getpid());
-    system(cmd);
-    system(cmd);
+    struct mapa mapa[2];
+    if (mapa_iniciar(&mapa[0], MAPA_CAPACIDAD, MAPA_MAX_REGIONES) ||
+        mapa_iniciar(&mapa[1], MAPA_CAPACIDAD, MAPA_MAX_REGIONES))
+        return 1;
+    mapa_mostrar(&mapa[0], NULL);
+    mapa_mostrar(&mapa[1], &mapa[0]);
     printf ("--\n") ;
     printf ("Variable / funcion Direccion                 Tamano\n") ;
-    printf ("              main %p\n", main);
-    printf ("               cos %p\n", cos);
-    printf ("         resultado %p %12ld\n", &resultado, sizeof(resultado));
+    mapa_variable(&mapa[1], "main", main, 0);
+    mapa_variable(&mapa[1], "cos", cos, 0);
+    mapa_variable(&mapa[1], "resultado", &resultado, sizeof(resultado));
     printf ("--\n") ;
-}
\ No newline at end of file
+}
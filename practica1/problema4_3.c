@@ -3,20 +3,26 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <dlfcn.h>
+#include "mapas.h"
 
 int main() {
     double numero = 0.0;
-    double (*cos_ptr)(double);
-    char cmd[50];
+    double (*cos_ptr)(double) = NULL;
+    struct mapa mapa[3];
 
-    sprintf(cmd, "cat /proc/%d/maps", getpid());
+    if (mapa_iniciar(&mapa[0], MAPA_CAPACIDAD, MAPA_MAX_REGIONES) ||
+        mapa_iniciar(&mapa[1], MAPA_CAPACIDAD, MAPA_MAX_REGIONES) ||
+        mapa_iniciar(&mapa[2], MAPA_CAPACIDAD, MAPA_MAX_REGIONES)) {
+        perror("Error al reservar los mapas");
+        exit(EXIT_FAILURE);
+    }
     
     printf("Mapa de memoria antes de dlopen:\n");
-    system(cmd);
+    mapa_mostrar(&mapa[0], NULL);
     printf("--\n");
     printf("Variable / funcion Direccion                  Tamaño\n");
-    printf("              main %p\n", main);
-    printf("    cos (dinamico) %p\n", cos_ptr);
+    mapa_variable(&mapa[0], "main", main, 0);
+    mapa_variable(&mapa[0], "cos (dinamico)", cos_ptr, 0);
     printf("--\n");
     
     void *handle = dlopen("libm.so.6", RTLD_LAZY);
@@ -35,23 +41,23 @@ int main() {
     double resultado = cos_ptr(numero);
 
     printf("Mapa de memoria despues de dlopen:\n");
-    system(cmd);
+    mapa_mostrar(&mapa[1], &mapa[0]);
     printf("--\n");
     printf("Variable / funcion Direccion                  Tamaño\n");
-    printf("              main %p\n", main);
-    printf("               cos %p\n", cos_ptr);
-    printf("         resultado %p  %12ld\n", &resultado, sizeof(resultado));
+    mapa_variable(&mapa[1], "main", main, 0);
+    mapa_variable(&mapa[1], "cos", cos_ptr, 0);
+    mapa_variable(&mapa[1], "resultado", &resultado, sizeof(resultado));
     printf("--\n");
 
     dlclose(handle);
     
     printf("Mapa de memoria después de dlclose:\n");
-    system(cmd);
+    mapa_mostrar(&mapa[2], &mapa[1]);
     printf("--\n");
     printf("Variable / funcion Direccion                  Tamaño\n");
-    printf("              main %p\n", main);
-    printf("               cos %p\n", cos_ptr);
-    printf("         resultado %p  %12ld\n", &resultado, sizeof(resultado));
+    mapa_variable(&mapa[2], "main", main, 0);
+    mapa_variable(&mapa[2], "cos", cos_ptr, 0);
+    mapa_variable(&mapa[2], "resultado", &resultado, sizeof(resultado));
     printf("--\n");
     
     return 0;
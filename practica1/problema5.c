@@ -2,45 +2,48 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include "mapas.h"
 int global=10;
 void *hilo1(void *arg);
 
+/* Reservados antes de la primera medida; el hilo usa mapa[1]. */
+struct mapa mapa[3];
+
 int main() {
-    char cmd[50];
-    sprintf(cmd, "cat /proc/%d/maps", getpid());
+    if (mapa_iniciar(&mapa[0], MAPA_CAPACIDAD, MAPA_MAX_REGIONES) ||
+        mapa_iniciar(&mapa[1], MAPA_CAPACIDAD, MAPA_MAX_REGIONES) ||
+        mapa_iniciar(&mapa[2], MAPA_CAPACIDAD, MAPA_MAX_REGIONES))
+        return 1;
     printf("Mapa de memoria antes de crear el hilo:\n");
-    system(cmd);
+    mapa_mostrar(&mapa[0], NULL);
     printf("--\n");
     printf("Variable / funcion Direccion                  Tamaño\n");
-    printf("              main %p\n", main);
-    printf("              hilo %p\n", hilo1);
-    printf("            global %p  %12ld\n", &global, sizeof(global));
+    mapa_variable(&mapa[0], "main", main, 0);
+    mapa_variable(&mapa[0], "hilo", hilo1, 0);
+    mapa_variable(&mapa[0], "global", &global, sizeof(global));
 
     pthread_t t1;
     pthread_create(&t1, NULL, hilo1, NULL);
     pthread_join(t1,NULL);
-    sprintf(cmd, "cat /proc/%d/maps", getpid());
     printf("Mapa de memoria despues del hilo:\n");
-    system(cmd);
+    mapa_mostrar(&mapa[2], &mapa[1]);
     printf("--\n");
     printf("Variable / funcion Direccion                  Tamaño\n");
-    printf("              main %p\n", main);
-    printf("              hilo %p\n", hilo1);
-    printf("            global %p  %12ld\n", &global, sizeof(global));
+    mapa_variable(&mapa[2], "main", main, 0);
+    mapa_variable(&mapa[2], "hilo", hilo1, 0);
+    mapa_variable(&mapa[2], "global", &global, sizeof(global));
     return 0;
 }
 void *hilo1(void *arg) {
     int local=10;
-    char cmd[50];
-    sprintf(cmd, "cat /proc/%d/maps", getpid());
     printf("Mapa de memoria en el hilo:\n");
-    system(cmd);
+    mapa_mostrar(&mapa[1], &mapa[0]);
     printf("--\n");
     printf("Variable / funcion Direccion                  Tamaño\n");
-    printf("              main %p\n", main);
-    printf("              hilo %p\n", hilo1);
-    printf("            global %p  %12ld\n", &global, sizeof(global));
-    printf("             local %p  %12ld\n", &local, sizeof(local));
+    mapa_variable(&mapa[1], "main", main, 0);
+    mapa_variable(&mapa[1], "hilo", hilo1, 0);
+    mapa_variable(&mapa[1], "global", &global, sizeof(global));
+    mapa_variable(&mapa[1], "local", &local, sizeof(local));
     printf("--\n");
     return 0;
-}
\ No newline at end of file
+}
@@ -2,47 +2,57 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include "mapas.h"
 int global=10;
 void *hilo1(void *arg);
 
+/* Reservados antes de la primera medida; cada hilo recibe el suyo. */
+struct mapa mapa[4];
+
 int main() {
-    char cmd[50];
-    sprintf(cmd, "cat /proc/%d/maps", getpid());
+    int i;
+    for (i = 0; i < 4; i++)
+        if (mapa_iniciar(&mapa[i], MAPA_CAPACIDAD, MAPA_MAX_REGIONES))
+            return 1;
     printf("Mapa de memoria antes de crear el hilo:\n");
-    system(cmd);
+    mapa_mostrar(&mapa[0], NULL);
     printf("--\n");
     printf("Variable / funcion Direccion                  Tamaño\n");
-    printf("              main %p\n", main);
-    printf("              hilo %p\n", hilo1);
-    printf("            global %p  %12ld\n", &global, sizeof(global));
+    mapa_variable(&mapa[0], "main", main, 0);
+    mapa_variable(&mapa[0], "hilo", hilo1, 0);
+    mapa_variable(&mapa[0], "global", &global, sizeof(global));
 
     pthread_t t1,t2;
-    pthread_create(&t1, NULL, hilo1, NULL);
-    pthread_create(&t2, NULL, hilo1, NULL);
+    pthread_create(&t1, NULL, hilo1, &mapa[1]);
+    pthread_create(&t2, NULL, hilo1, &mapa[2]);
     pthread_join(t1,NULL);
     pthread_join(t2,NULL);
-    sprintf(cmd, "cat /proc/%d/maps", getpid());
     printf("Mapa de memoria despues del hilo:\n");
-    system(cmd);
+    mapa_mostrar(&mapa[3], &mapa[0]);
     printf("--\n");
     printf("Variable / funcion Direccion                  Tamaño\n");
-    printf("              main %p\n", main);
-    printf("              hilo %p\n", hilo1);
-    printf("            global %p  %12ld\n", &global, sizeof(global));
+    mapa_variable(&mapa[3], "main", main, 0);
+    mapa_variable(&mapa[3], "hilo", hilo1, 0);
+    mapa_variable(&mapa[3], "global", &global, sizeof(global));
     return 0;
 }
 void *hilo1(void *arg) {
+    struct mapa *propio = arg;
     int local=10;
-    char cmd[50];
-    sprintf(cmd, "cat /proc/%d/maps", getpid());
+    mapa_leer(propio, 0);
+    /* Los dos hilos escriben a la vez: se imprime todo junto bajo el bloqueo de stdout. */
+    flockfile(stdout);
     printf("Mapa de memoria en el hilo:\n");
-    system(cmd);
+    mapa_imprimir(propio);
+    printf("Cambios respecto al mapa anterior:\n");
+    mapa_diferencias(&mapa[0], propio);
     printf("--\n");
     printf("Variable / funcion Direccion                  Tamaño\n");
-    printf("              main %p\n", main);
-    printf("              hilo %p\n", hilo1);
-    printf("            global %p  %12ld\n", &global, sizeof(global));
-    printf("             local %p  %12ld\n", &local, sizeof(local));
+    mapa_variable(propio, "main", main, 0);
+    mapa_variable(propio, "hilo", hilo1, 0);
+    mapa_variable(propio, "global", &global, sizeof(global));
+    mapa_variable(propio, "local", &local, sizeof(local));
     printf("--\n");
+    funlockfile(stdout);
     return 0;
-}
\ No newline at end of file
+}
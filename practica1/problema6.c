@@ -2,44 +2,42 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include "mapas.h"
 
 int main() {
-    char cmd[50];
+    struct mapa mapa[2];
     int variable =5;
-    sprintf(cmd, "cat /proc/%d/maps", getpid());
+    if (mapa_iniciar(&mapa[0], MAPA_CAPACIDAD, MAPA_MAX_REGIONES) ||
+        mapa_iniciar(&mapa[1], MAPA_CAPACIDAD, MAPA_MAX_REGIONES))
+        return 1;
     printf("Mapa de memoria antes de crear el hilo:\n");
-    system(cmd);
+    mapa_mostrar(&mapa[0], NULL);
     printf("--\n");
     printf("Variable / funcion Direccion                  Tamaño\n");
-    printf("              main %p\n", main);
-    printf("          variable %p  %12ld\n", &variable, sizeof(variable));
+    mapa_variable(&mapa[0], "main", main, 0);
+    mapa_variable(&mapa[0], "variable", &variable, sizeof(variable));
+    fflush(stdout);
         int pid = fork () ;
         if(pid==0){
             printf ("Soy el hijo y mi pid es:%d\n",getpid());
             int variable_hijo = 10;
-            char cmd[50];
-            int variable =5;
-            sprintf(cmd, "cat /proc/%d/maps", getpid());
             printf("Mapa de memoria en el hijo:\n");
-            system(cmd);
+            mapa_mostrar(&mapa[1], &mapa[0]);
             printf("--\n");
             printf("Variable / funcion Direccion                  Tamaño\n");
-            printf("              main %p\n", main);
-            printf("          variable %p  %12ld\n", &variable_hijo, sizeof(variable_hijo));
+            mapa_variable(&mapa[1], "main", main, 0);
+            mapa_variable(&mapa[1], "variable", &variable_hijo, sizeof(variable_hijo));
         }
         else{
             sleep(3);
             printf (" Soy el padre , mi pid es:%d y el pid de mi hijo es:%d\n", getpid () , pid ) ;
             int variable_padre = 15;
-            char cmd[50];
-            int variable =5;
-            sprintf(cmd, "cat /proc/%d/maps", getpid());
             printf("Mapa de memoria en el hijo:\n");
-            system(cmd);
+            mapa_mostrar(&mapa[1], &mapa[0]);
             printf("--\n");
             printf("Variable / funcion Direccion                  Tamaño\n");
-            printf("              main %p\n", main);
-            printf("    variable_padre %p  %12ld\n", &variable_padre, sizeof(variable_padre));
+            mapa_variable(&mapa[1], "main", main, 0);
+            mapa_variable(&mapa[1], "variable_padre", &variable_padre, sizeof(variable_padre));
             sleep(3);
         }
 }
@@ -0,0 +1,299 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "assoofs.h"
+
+/*
+ * Microbenchmarks for a mounted assoofs filesystem (module or assoofs-fuse).
+ * Each run prints one CSV row with throughput and latency percentiles.
+ * bench.sh formats a fresh loop device for every run, since one image only
+ * holds ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED objects.
+ */
+#define USAGE "Usage: assoofs-bench [-H] [-l label] [-i iterations] [-t threads] [-c] <mountpoint> <test>\n" \
+              "Tests: create lookup-hit lookup-miss readdir write-small write-large read-small read-large\n"
+#define SMALL_IO 64
+#define LARGE_IO (ASSOOFS_DEFAULT_BLOCK_SIZE - 96) /* largest write the module accepts, rounded */
+#define FILESET_DIR "fileset"
+#define FILESET_FILES (ASSOOFS_DIR_RECORDS_PER_BLOCK - 1)
+
+struct bench {
+    const char *mnt;
+    const char *test;
+    int iterations;
+    int threads;
+    int drop_caches;
+    uint64_t *lat;          /* nanoseconds, iterations * threads samples */
+};
+
+struct worker {
+    struct bench *b;
+    int id;
+    int ops;                /* operations done by this worker */
+    int failed;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Force the next lookup to reach the filesystem instead of the dcache. */
+static void drop_caches(struct bench *b) {
+    int fd;
+
+    if (!b->drop_caches)
+        return;
+    sync();
+    fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+    if (fd != -1) {
+        if (write(fd, "2", 1) != 1)
+            perror("drop_caches");
+        close(fd);
+    }
+}
+
+static void fileset_path(struct bench *b, int i, char *path) {
+    snprintf(path, PATH_MAX, "%s/" FILESET_DIR "/f%02d", b->mnt, (int)(i % FILESET_FILES));
+}
+
+/* Untimed setup for the tests that need existing files. */
+static int make_fileset(struct bench *b) {
+    char path[PATH_MAX], buf[LARGE_IO];
+    int i, fd;
+
+    snprintf(path, sizeof(path), "%s/" FILESET_DIR, b->mnt);
+    if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+        perror(path);
+        return -1;
+    }
+    memset(buf, 'a', sizeof(buf));
+    for (i = 0; i < FILESET_FILES; i++) {
+        fileset_path(b, i, path);
+        fd = open(path, O_CREAT | O_WRONLY, 0644);
+        if (fd == -1 || write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+            perror(path);
+            return -1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+static int op_create(struct worker *w, int i) {
+    char path[PATH_MAX];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/t%d/f%d", w->b->mnt, w->id, i);
+    fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+    if (fd == -1)
+        return -1;
+    return close(fd);
+}
+
+static int op_lookup(struct worker *w, int i) {
+    char path[PATH_MAX];
+    struct stat st;
+
+    if (!strcmp(w->b->test, "lookup-miss")) {
+        snprintf(path, sizeof(path), "%s/" FILESET_DIR "/missing%d", w->b->mnt, i);
+        return stat(path, &st) == -1 && errno == ENOENT ? 0 : -1;
+    }
+    fileset_path(w->b, i, path);
+    return stat(path, &st);
+}
+
+static int op_readdir(struct worker *w, int i) {
+    char path[PATH_MAX];
+    DIR *dir;
+
+    snprintf(path, sizeof(path), "%s/" FILESET_DIR, w->b->mnt);
+    dir = opendir(path);
+    if (!dir)
+        return -1;
+    while (readdir(dir))
+        ;
+    return closedir(dir);
+}
+
+static int op_io(struct worker *w, int i) {
+    size_t len = strstr(w->b->test, "large") ? LARGE_IO : SMALL_IO;
+    char path[PATH_MAX], buf[LARGE_IO];
+    ssize_t ret;
+    int fd;
+
+    fileset_path(w->b, i, path);
+    if (!strncmp(w->b->test, "write", 5)) {
+        memset(buf, 'b', len);
+        fd = open(path, O_WRONLY);
+        if (fd == -1)
+            return -1;
+        ret = write(fd, buf, len);
+    } else {
+        fd = open(path, O_RDONLY);
+        if (fd == -1)
+            return -1;
+        ret = read(fd, buf, len);
+    }
+    close(fd);
+    return ret == (ssize_t)len ? 0 : -1;
+}
+
+static int (*pick_op(const char *test))(struct worker *, int) {
+    if (!strcmp(test, "create"))
+        return op_create;
+    if (!strcmp(test, "lookup-hit") || !strcmp(test, "lookup-miss"))
+        return op_lookup;
+    if (!strcmp(test, "readdir"))
+        return op_readdir;
+    if (!strcmp(test, "write-small") || !strcmp(test, "write-large") ||
+        !strcmp(test, "read-small") || !strcmp(test, "read-large"))
+        return op_io;
+    return NULL;
+}
+
+static void *run_worker(void *arg) {
+    struct worker *w = arg;
+    int (*op)(struct worker *, int) = pick_op(w->b->test);
+    uint64_t *lat = w->b->lat + (size_t)w->id * w->b->iterations;
+    uint64_t start;
+    int i;
+
+    for (i = 0; i < w->b->iterations; i++) {
+        if (w->b->threads == 1)
+            drop_caches(w->b);
+        start = now_ns();
+        if (op(w, i)) {
+            w->failed = errno ? errno : EIO;
+            break;
+        }
+        lat[w->ops++] = now_ns() - start;
+    }
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_us(const uint64_t *sorted, size_t n, double p) {
+    size_t i = (size_t)(p * (n - 1) + 0.5);
+
+    return sorted[i] / 1000.0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench b = { .iterations = 1000, .threads = 1 };
+    struct worker *workers;
+    pthread_t *tids;
+    const char *label = "assoofs";
+    char path[PATH_MAX];
+    uint64_t start, elapsed;
+    size_t n = 0;
+    int opt, i, failed = 0;
+
+    while ((opt = getopt(argc, argv, "Hl:i:t:c")) != -1) {
+        switch (opt) {
+        case 'H':
+            printf("fs,test,threads,ops,ops_per_sec,p50_us,p90_us,p99_us,max_us,errors\n");
+            if (argc == 2)
+                return 0;
+            break;
+        case 'l':
+            label = optarg;
+            break;
+        case 'i':
+            b.iterations = atoi(optarg);
+            break;
+        case 't':
+            b.threads = atoi(optarg);
+            break;
+        case 'c':
+            b.drop_caches = 1;
+            break;
+        default:
+            fprintf(stderr, USAGE);
+            return 1;
+        }
+    }
+    if (optind != argc - 2 || b.iterations < 1 || b.threads < 1 || !pick_op(argv[optind + 1])) {
+        fprintf(stderr, USAGE);
+        return 1;
+    }
+    b.mnt = argv[optind];
+    b.test = argv[optind + 1];
+
+    if (!strcmp(b.test, "create")) {
+        /* One directory per thread; both limits of the format apply. */
+        for (i = 0; i < b.threads; i++) {
+            snprintf(path, sizeof(path), "%s/t%d", b.mnt, i);
+            if (mkdir(path, 0755) == -1) {
+                perror(path);
+                return 1;
+            }
+        }
+        i = (ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED - 2 - b.threads) / b.threads; /* root, README.txt */
+        if (i > (int)ASSOOFS_DIR_RECORDS_PER_BLOCK)
+            i = ASSOOFS_DIR_RECORDS_PER_BLOCK;
+        if (b.iterations > i)
+            b.iterations = i;
+    } else if (make_fileset(&b)) {
+        return 1;
+    }
+
+    b.lat = calloc((size_t)b.iterations * b.threads, sizeof(*b.lat));
+    workers = calloc(b.threads, sizeof(*workers));
+    tids = calloc(b.threads, sizeof(*tids));
+    if (!b.lat || !workers || !tids) {
+        perror("Error allocating the samples");
+        return 1;
+    }
+
+    start = now_ns();
+    for (i = 0; i < b.threads; i++) {
+        workers[i].b = &b;
+        workers[i].id = i;
+        pthread_create(&tids[i], NULL, run_worker, &workers[i]);
+    }
+    for (i = 0; i < b.threads; i++)
+        pthread_join(tids[i], NULL);
+    elapsed = now_ns() - start;
+
+    /* Pack every worker's samples together before sorting. */
+    for (i = 0; i < b.threads; i++) {
+        memmove(b.lat + n, b.lat + (size_t)i * b.iterations, workers[i].ops * sizeof(*b.lat));
+        n += workers[i].ops;
+        if (workers[i].failed) {
+            fprintf(stderr, "%s: thread %d stopped after %d ops: %s\n",
+                    b.test, i, workers[i].ops, strerror(workers[i].failed));
+            failed++;
+        }
+    }
+    if (!n) {
+        fprintf(stderr, "%s: no operation succeeded\n", b.test);
+        return 1;
+    }
+    qsort(b.lat, n, sizeof(*b.lat), cmp_u64);
+
+    printf("%s,%s,%d,%zu,%.0f,%.1f,%.1f,%.1f,%.1f,%d\n", label, b.test, b.threads, n,
+           n / (elapsed / 1e9), percentile_us(b.lat, n, 0.50), percentile_us(b.lat, n, 0.90),
+           percentile_us(b.lat, n, 0.99), b.lat[n - 1] / 1000.0, failed);
+
+    free(tids);
+    free(workers);
+    free(b.lat);
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <libgen.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "libassoofs.h"
+
+/*
+ * Offline layout optimizer. The tree is walked depth-first from the root;
+ * for every directory its entry block comes first, then the inodes and data
+ * of its files in name order, then each subdirectory the same way. Inode
+ * numbers, the inode store and the directory entries are rewritten to
+ * match, so a cold "ls -R" followed by reading every file is one forward
+ * sweep over the device.
+ *
+ * The device is only read. The new image is written to a temporary file
+ * that is renamed over the image (or over -o output) once it is on disk,
+ * so an interrupted run leaves the old image untouched.
+ */
+#define UNSET ((uint64_t)-1)
+#define USAGE "Usage: assoofs-defrag [-n] [-o <output>] <device>\n" \
+              "The new layout replaces the image file, or is written to <output>\n" \
+              "(needed for block devices). The device must not be mounted.\n"
+
+struct defrag {
+    struct assoofs_image img;
+    char *out;                                                 /* the new image */
+    struct assoofs_inode_info *out_inodes;
+    uint64_t inodes_count;
+    uint64_t blocks_count;
+    uint64_t new_ino[ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED];   /* old inode number -> new */
+    uint64_t new_block[ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED]; /* old block -> new, 0 = not moved yet */
+    uint64_t prev_block, prev_new_block;                       /* last block visited, old and new layout */
+    unsigned breaks_before, breaks_after;                      /* non-consecutive steps in each layout */
+};
+
+static char *out_block(struct defrag *d, uint64_t block) {
+    return d->out + block * ASSOOFS_DEFAULT_BLOCK_SIZE;
+}
+
+/* Copy an old block to the next free position of the new image. */
+static int place_block(struct defrag *d, uint64_t old, uint64_t *new) {
+    if (old >= d->img.blocks_count || old <= ASSOOFS_INODESTORE_BLOCK_NUMBER) {
+        printf("Block %llu is not a data block; run fsck.assoofs first.\n", (unsigned long long)old);
+        return -1;
+    }
+    if (old != d->prev_block + 1)
+        d->breaks_before++;
+    d->prev_block = old;
+
+    if (!d->new_block[old]) {
+        d->new_block[old] = d->blocks_count++;
+        memcpy(out_block(d, d->new_block[old]), assoofs_image_block(&d->img, old), ASSOOFS_DEFAULT_BLOCK_SIZE);
+    }
+    *new = d->new_block[old];
+    if (*new != d->prev_new_block + 1)
+        d->breaks_after++; /* only when a block is shared by several inodes */
+    d->prev_new_block = *new;
+    return 0;
+}
+
+static struct assoofs_inode_info *place_inode(struct defrag *d, const struct assoofs_inode_info *old) {
+    struct assoofs_inode_info *inode;
+
+    if (d->new_ino[old->inode_no] != UNSET) {
+        printf("Inode %llu is linked twice; run fsck.assoofs first.\n", (unsigned long long)old->inode_no);
+        return NULL;
+    }
+    inode = &d->out_inodes[d->inodes_count];
+    *inode = *old;
+    inode->inode_no = d->inodes_count++;
+    d->new_ino[old->inode_no] = inode->inode_no;
+    return inode;
+}
+
+static int cmp_records(const void *a, const void *b) {
+    const struct assoofs_dir_record_entry *x = *(struct assoofs_dir_record_entry *const *)a;
+    const struct assoofs_dir_record_entry *y = *(struct assoofs_dir_record_entry *const *)b;
+
+    return strncmp(x->filename, y->filename, ASSOOFS_FILENAME_MAXLEN);
+}
+
+static int place_directory(struct defrag *d, const struct assoofs_inode_info *old_dir,
+                           struct assoofs_inode_info *dir) {
+    struct assoofs_dir_record_entry *sorted[ASSOOFS_DIR_RECORDS_PER_BLOCK];
+    struct assoofs_dir_record_entry *records = assoofs_image_dirents(&d->img, old_dir);
+    struct assoofs_dir_record_entry *out;
+    struct assoofs_inode_info *old, *child[ASSOOFS_DIR_RECORDS_PER_BLOCK];
+    uint64_t i, n = 0;
+
+    if (!records) {
+        printf("Directory inode %llu is damaged; run fsck.assoofs first.\n", (unsigned long long)old_dir->inode_no);
+        return -1;
+    }
+    if (place_block(d, old_dir->data_block_number, &dir->data_block_number))
+        return -1;
+    out = (struct assoofs_dir_record_entry *)out_block(d, dir->data_block_number);
+    memset(out, 0, ASSOOFS_DEFAULT_BLOCK_SIZE);
+
+    /* Removed entries are dropped, the rest sorted by name. */
+    for (i = 0; i < old_dir->dir_children_count; i++)
+        if (records[i].entry_removed == ASSOOFS_FALSE)
+            sorted[n++] = &records[i];
+    qsort(sorted, n, sizeof(*sorted), cmp_records);
+
+    /* Inodes of every child, and file data, before any subdirectory. */
+    for (i = 0; i < n; i++) {
+        old = assoofs_image_inode(&d->img, sorted[i]->inode_no);
+        if (!old || old->inode_no >= ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED) {
+            printf("Entry '%.*s' points to a missing inode; run fsck.assoofs first.\n",
+                   ASSOOFS_FILENAME_MAXLEN, sorted[i]->filename);
+            return -1;
+        }
+        child[i] = place_inode(d, old);
+        if (!child[i])
+            return -1;
+        if (S_ISREG(old->mode) && old->data_block_number != ASSOOFS_NO_DATA_BLOCK &&
+            place_block(d, old->data_block_number, &child[i]->data_block_number))
+            return -1;
+
+        memcpy(out[i].filename, sorted[i]->filename, ASSOOFS_FILENAME_MAXLEN);
+        out[i].inode_no = child[i]->inode_no;
+        out[i].entry_removed = ASSOOFS_FALSE;
+    }
+    dir->dir_children_count = n;
+
+    for (i = 0; i < n; i++) {
+        if (!S_ISDIR(child[i]->mode))
+            continue;
+        old = assoofs_image_inode(&d->img, sorted[i]->inode_no);
+        if (place_directory(d, old, child[i]))
+            return -1;
+    }
+    return 0;
+}
+
+/* Loop device the file at path is attached to: renaming over it would not reach the mount. */
+static int attached_loop(const char *path, char *loop, size_t size) {
+    char real[PATH_MAX], backing[PATH_MAX];
+    glob_t g;
+    size_t i, n;
+    FILE *f;
+    int found = 0;
+
+    if (!realpath(path, real) || glob("/sys/block/loop*/loop/backing_file", 0, NULL, &g))
+        return 0;
+    for (i = 0; i < g.gl_pathc && !found; i++) {
+        f = fopen(g.gl_pathv[i], "r");
+        if (!f)
+            continue;
+        n = fread(backing, 1, sizeof(backing) - 1, f);
+        fclose(f);
+        backing[n] = '\0';
+        backing[strcspn(backing, "\n")] = '\0';
+        if (!strcmp(backing, real)) {
+            /* /sys/block/<loop>/loop/backing_file */
+            snprintf(loop, size, "/dev/%.*s", (int)strcspn(g.gl_pathv[i] + 11, "/"), g.gl_pathv[i] + 11);
+            found = 1;
+        }
+    }
+    globfree(&g);
+    return found;
+}
+
+/* Write the new image next to target, flush it and rename it over target. */
+static int replace_image(struct defrag *d, const char *target, off_t size, mode_t mode) {
+    size_t len = d->img.blocks_count * ASSOOFS_DEFAULT_BLOCK_SIZE, done;
+    char tmp[PATH_MAX], dir[PATH_MAX];
+    ssize_t ret;
+    int fd;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", target) >= (int)sizeof(tmp)) {
+        printf("%s: path too long.\n", target);
+        return -1;
+    }
+    fd = mkstemp(tmp);
+    if (fd == -1) {
+        perror(tmp);
+        return -1;
+    }
+    for (done = 0; done < len; done += ret) {
+        ret = write(fd, d->out + done, len - done);
+        if (ret == -1)
+            goto fail;
+    }
+    if (ftruncate(fd, size) == -1 || fchmod(fd, mode) == -1 || fsync(fd) == -1)
+        goto fail;
+    if (close(fd) == -1) {
+        fd = -1;
+        goto fail;
+    }
+    fd = -1;
+    if (rename(tmp, target) == -1)
+        goto fail;
+
+    /* And the rename itself. */
+    snprintf(dir, sizeof(dir), "%s", target);
+    fd = open(dirname(dir), O_RDONLY | O_DIRECTORY);
+    if (fd != -1) {
+        fsync(fd);
+        close(fd);
+    }
+    return 0;
+
+fail:
+    perror(tmp);
+    if (fd != -1)
+        close(fd);
+    unlink(tmp);
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    struct assoofs_super_block_info *sb;
+    struct assoofs_inode_info *root;
+    struct defrag *d;
+    struct stat st, target_st;
+    const char *target = NULL;
+    char loop[PATH_MAX];
+    uint64_t i, max_blocks, max_inodes;
+    int opt, dry_run = 0, ret = 1;
+
+    while ((opt = getopt(argc, argv, "no:")) != -1) {
+        switch (opt) {
+        case 'n':
+            dry_run = 1;
+            break;
+        case 'o':
+            target = optarg;
+            break;
+        default:
+            printf(USAGE);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        printf(USAGE);
+        return 1;
+    }
+    if (stat(argv[optind], &st) == -1) {
+        perror(argv[optind]);
+        return 1;
+    }
+    if (!target && !S_ISREG(st.st_mode) && !dry_run) {
+        printf("%s is not an image file; write the new layout to one with -o.\n", argv[optind]);
+        return 1;
+    }
+    if (!target)
+        target = argv[optind];
+    if (!dry_run && stat(target, &target_st) == 0 && !S_ISREG(target_st.st_mode)) {
+        printf("%s: not a regular file.\n", target);
+        return 1;
+    }
+    if (!dry_run && (attached_loop(argv[optind], loop, sizeof(loop)) || attached_loop(target, loop, sizeof(loop)))) {
+        printf("The image is attached to %s; unmount and detach it first.\n", loop);
+        return 1;
+    }
+
+    d = calloc(1, sizeof(*d));
+    if (!d) {
+        perror("Error allocating the defragmenter state");
+        return 1;
+    }
+    if (assoofs_image_open(&d->img, argv[optind], dry_run ? 0 : ASSOOFS_IMAGE_EXCL)) {
+        if (errno == EINVAL)
+            printf("%s: not an assoofs filesystem (bad superblock).\n", argv[optind]);
+        else if (errno == EBUSY)
+            printf("%s: device is busy; unmount it before defragmenting.\n", argv[optind]);
+        else
+            perror(argv[optind]);
+        free(d);
+        return 1;
+    }
+
+    d->out = calloc(d->img.blocks_count, ASSOOFS_DEFAULT_BLOCK_SIZE);
+    if (!d->out) {
+        perror("Error allocating the new image");
+        goto out;
+    }
+    memcpy(d->out, d->img.sb, ASSOOFS_DEFAULT_BLOCK_SIZE);
+    d->out_inodes = (struct assoofs_inode_info *)out_block(d, ASSOOFS_INODESTORE_BLOCK_NUMBER);
+    d->blocks_count = ASSOOFS_ROOTDIR_BLOCK_NUMBER;
+    d->prev_block = d->prev_new_block = ASSOOFS_INODESTORE_BLOCK_NUMBER;
+    for (i = 0; i < ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED; i++)
+        d->new_ino[i] = UNSET;
+
+    root = assoofs_image_inode(&d->img, ASSOOFS_ROOTDIR_INODE_NUMBER);
+    if (!root || root->data_block_number != ASSOOFS_ROOTDIR_BLOCK_NUMBER) {
+        printf("The root directory is damaged; run fsck.assoofs first.\n");
+        goto out;
+    }
+    if (place_directory(d, root, place_inode(d, root)))
+        goto out;
+    if (d->inodes_count != assoofs_image_inodes_count(&d->img)) {
+        printf("%llu inodes are not reachable from the root; run fsck.assoofs first.\n",
+               (unsigned long long)(assoofs_image_inodes_count(&d->img) - d->inodes_count));
+        goto out;
+    }
+
+    /* Keep the geometry, with every used object packed at the start. */
+    max_inodes = assoofs_image_max_inodes(&d->img);
+    max_blocks = assoofs_image_max_blocks(&d->img);
+
+    sb = (struct assoofs_super_block_info *)d->out;
+    memset(sb->block_refcount, 0, sizeof(sb->block_refcount));
+    for (i = 0; i < ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED; i++)
+        if (d->new_block[i])
+            sb->block_refcount[d->new_block[i]] = d->img.sb->block_refcount[i];
+    sb->inodes_count = d->inodes_count;
+    sb->free_inodes = assoofs_free_mask(d->inodes_count, max_inodes);
+    sb->free_blocks = assoofs_free_mask(d->blocks_count, max_blocks);
+
+    printf("%llu inodes, %llu blocks: %u seeks in traversal order before, %u after.\n",
+           (unsigned long long)d->inodes_count, (unsigned long long)d->blocks_count,
+           d->breaks_before, d->breaks_after);
+
+    if (dry_run) {
+        ret = 0;
+        goto out;
+    }
+    /* Zero past the packed blocks, so no stale records survive: the module does not clear them. */
+    if (replace_image(d, target, S_ISREG(st.st_mode) ? st.st_size : (off_t)(d->img.size),
+                      S_ISREG(st.st_mode) ? st.st_mode & 07777 : 0644))
+        goto out;
+    printf("%s written.\n", target);
+    ret = 0;
+out:
+    free(d->out);
+    assoofs_image_close(&d->img);
+    free(d);
+    return ret;
+}
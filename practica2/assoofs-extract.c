@@ -0,0 +1,225 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "libassoofs.h"
+
+/*
+ * Copy the whole tree of an assoofs image to a host directory without the
+ * module. Directories are created while walking from the root; files are
+ * then written by a pool of threads, with copy_file_range from the image
+ * fd when the kernel can do it in place and a write from the mapping
+ * otherwise.
+ */
+#define USAGE "Usage: assoofs-extract [-j threads] <device> <directory>\n"
+
+struct job {
+    const struct assoofs_inode_info *inode;
+    char path[PATH_MAX];
+};
+
+struct extract {
+    struct assoofs_image img;
+    struct job jobs[ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED];
+    unsigned jobs_count;
+    unsigned next_job;          /* taken with __atomic_fetch_add by the workers */
+    unsigned copied;            /* files, counted by the workers */
+    unsigned failed;
+    unsigned skipped;           /* entries the walk could not extract */
+    unsigned directories;       /* created or already there */
+    unsigned visited;           /* directories walked, to stop on a cycle */
+};
+
+static mode_t permissions(const struct assoofs_inode_info *inode) {
+    /* mkassoofs and the module may store a bare S_IFDIR/S_IFREG */
+    if (!(inode->mode & 07777))
+        return S_ISDIR(inode->mode) ? 0755 : 0644;
+    return inode->mode & 07777;
+}
+
+static int walk(struct extract *e, const struct assoofs_inode_info *dir, const char *path) {
+    const struct assoofs_dir_record_entry *record = assoofs_image_dirents(&e->img, dir);
+    const struct assoofs_inode_info *child;
+    char child_path[PATH_MAX];
+    struct stat st;
+    uint64_t i;
+
+    if (!record) {
+        printf("Directory inode %llu is damaged; run fsck.assoofs.\n", (unsigned long long)dir->inode_no);
+        return -1;
+    }
+    for (i = 0; i < dir->dir_children_count; i++) {
+        if (record[i].entry_removed != ASSOOFS_FALSE)
+            continue;
+        child = assoofs_image_inode(&e->img, record[i].inode_no);
+        if (!child || !memchr(record[i].filename, '\0', ASSOOFS_FILENAME_MAXLEN) ||
+            strchr(record[i].filename, '/') || !strcmp(record[i].filename, ".") ||
+            !strcmp(record[i].filename, "..") || (!S_ISDIR(child->mode) && !S_ISREG(child->mode)) ||
+            (S_ISREG(child->mode) && e->jobs_count >= ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED)) {
+            printf("Skipping a damaged entry in directory inode %llu.\n", (unsigned long long)dir->inode_no);
+            e->skipped++;
+            continue;
+        }
+        if (snprintf(child_path, sizeof(child_path), "%s/%s", path, record[i].filename) >= PATH_MAX) {
+            printf("%s/%s: path too long.\n", path, record[i].filename);
+            e->skipped++;
+            continue;
+        }
+
+        if (S_ISDIR(child->mode)) {
+            if (e->visited++ >= ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED) {
+                printf("Directory cycle in the image; run fsck.assoofs.\n");
+                return -1;
+            }
+            if (mkdir(child_path, permissions(child)) == -1 &&
+                (errno != EEXIST || stat(child_path, &st) == -1 || !S_ISDIR(st.st_mode))) {
+                if (errno == EEXIST)
+                    errno = ENOTDIR;
+                perror(child_path);
+                e->skipped++;
+                continue;
+            }
+            e->directories++;
+            if (walk(e, child, child_path))
+                return -1;
+        } else {
+            e->jobs[e->jobs_count].inode = child;
+            strcpy(e->jobs[e->jobs_count].path, child_path);
+            e->jobs_count++;
+        }
+    }
+    return 0;
+}
+
+static int copy_file(struct extract *e, const struct job *job) {
+    const struct assoofs_inode_info *inode = job->inode;
+    size_t size = inode->file_size;
+    loff_t off = inode->data_block_number * ASSOOFS_DEFAULT_BLOCK_SIZE;
+    const char *data;
+    ssize_t ret;
+    int fd;
+
+    fd = open(job->path, O_CREAT | O_WRONLY | O_TRUNC, permissions(inode));
+    if (fd == -1) {
+        perror(job->path);
+        return -1;
+    }
+    if (inode->data_block_number == ASSOOFS_NO_DATA_BLOCK || !size)
+        return close(fd);
+
+    data = assoofs_image_block(&e->img, inode->data_block_number);
+    if (!data || size > ASSOOFS_DEFAULT_BLOCK_SIZE) {
+        printf("%s: damaged inode %llu; run fsck.assoofs.\n", job->path, (unsigned long long)inode->inode_no);
+        close(fd);
+        return -1;
+    }
+
+    /* Block devices and some filesystem pairs cannot copy_file_range. */
+    while (size) {
+        ret = copy_file_range(e->img.fd, &off, fd, NULL, size, 0);
+        if (ret <= 0)
+            break;
+        size -= ret;
+    }
+    if (size) {
+        data += inode->file_size - size;
+        while (size) {
+            ret = write(fd, data, size);
+            if (ret == -1) {
+                perror(job->path);
+                close(fd);
+                return -1;
+            }
+            data += ret;
+            size -= ret;
+        }
+    }
+    return close(fd);
+}
+
+static void *worker(void *arg) {
+    struct extract *e = arg;
+    unsigned i;
+
+    while ((i = __atomic_fetch_add(&e->next_job, 1, __ATOMIC_RELAXED)) < e->jobs_count)
+        __atomic_fetch_add(copy_file(e, &e->jobs[i]) ? &e->failed : &e->copied, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const struct assoofs_inode_info *root;
+    struct extract *e;
+    pthread_t tids[ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED];
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt, i, started, ret = 1;
+    char *end;
+
+    while ((opt = getopt(argc, argv, "j:")) != -1) {
+        if (opt != 'j') {
+            printf(USAGE);
+            return 1;
+        }
+        threads = strtol(optarg, &end, 10);
+        if (end == optarg || *end || threads < 1) {
+            printf(USAGE);
+            return 1;
+        }
+    }
+    if (optind != argc - 2 || threads < 1) {
+        printf(USAGE);
+        return 1;
+    }
+    if (threads > ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED)
+        threads = ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED;
+
+    e = calloc(1, sizeof(*e));
+    if (!e) {
+        perror("Error allocating the extractor state");
+        return 1;
+    }
+    if (assoofs_image_open(&e->img, argv[optind], 0)) {
+        if (errno == EINVAL)
+            printf("%s: not an assoofs filesystem (bad superblock).\n", argv[optind]);
+        else
+            perror(argv[optind]);
+        free(e);
+        return 1;
+    }
+
+    root = assoofs_image_inode(&e->img, ASSOOFS_ROOTDIR_INODE_NUMBER);
+    if (!root) {
+        printf("The root directory is missing; run fsck.assoofs.\n");
+        goto out;
+    }
+    if (mkdir(argv[optind + 1], 0755) == -1 && errno != EEXIST) {
+        perror(argv[optind + 1]);
+        goto out;
+    }
+    if (walk(e, root, argv[optind + 1]))
+        goto out;
+
+    if (threads > e->jobs_count)
+        threads = e->jobs_count ? e->jobs_count : 1;
+    for (started = 0; started < threads; started++)
+        if (pthread_create(&tids[started], NULL, worker, e))
+            break;
+    if (!started)
+        worker(e); /* no thread could be created: copy everything from here */
+    for (i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    printf("%u directories and %u files extracted, %u files failed, %u entries skipped.\n",
+           e->directories, e->copied, e->failed, e->skipped);
+    ret = e->failed || e->skipped ? 1 : 0;
+out:
+    assoofs_image_close(&e->img);
+    free(e);
+    return ret;
+}
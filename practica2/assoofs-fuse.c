@@ -0,0 +1,400 @@
+#define FUSE_USE_VERSION 35
+#define _GNU_SOURCE
+
+#include <fuse_lowlevel.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include "libassoofs.h"
+
+/*
+ * assoofs served from userspace with the FUSE low-level API.
+ *
+ * The image is mmap'ed through libassoofs and every request works on the
+ * mapping directly. FUSE inode numbers are assoofs inode numbers + 1, since
+ * FUSE reserves 1 (FUSE_ROOT_ID) for the root and assoofs numbers it 0.
+ * All changes go through this daemon, so the kernel is allowed to keep
+ * dentries, attributes and file pages cached for a long time.
+ */
+#define TO_FUSE_INO(ino) ((fuse_ino_t)(ino) + 1)
+#define TO_ASSOOFS_INO(ino) ((uint64_t)(ino) - 1)
+#define CACHE_TIMEOUT 3600.0
+
+struct assoofs_fuse {
+    struct assoofs_image img;
+    pthread_rwlock_t lock;     /* readers: lookup/getattr/readdir/read; writers: the rest */
+};
+
+static struct assoofs_fuse *fs_of(fuse_req_t req) {
+    return fuse_req_userdata(req);
+}
+
+static void fill_stat(const struct assoofs_inode_info *inode, struct stat *st) {
+    memset(st, 0, sizeof(*st));
+    st->st_ino = TO_FUSE_INO(inode->inode_no);
+    st->st_mode = inode->mode;
+    /* mkassoofs and the module may store a bare S_IFDIR/S_IFREG */
+    if (!(st->st_mode & 07777))
+        st->st_mode |= S_ISDIR(inode->mode) ? 0755 : 0644;
+    st->st_nlink = S_ISDIR(inode->mode) ? 2 : 1;
+    st->st_uid = getuid();
+    st->st_gid = getgid();
+    st->st_size = S_ISDIR(inode->mode) ? ASSOOFS_DEFAULT_BLOCK_SIZE : inode->file_size;
+    st->st_blksize = ASSOOFS_DEFAULT_BLOCK_SIZE;
+    st->st_blocks = inode->data_block_number == ASSOOFS_NO_DATA_BLOCK ? 0 : ASSOOFS_DEFAULT_BLOCK_SIZE / 512;
+}
+
+static void reply_entry(fuse_req_t req, const struct assoofs_inode_info *inode) {
+    struct fuse_entry_param e;
+
+    memset(&e, 0, sizeof(e));
+    e.ino = TO_FUSE_INO(inode->inode_no);
+    e.attr_timeout = CACHE_TIMEOUT;
+    e.entry_timeout = CACHE_TIMEOUT;
+    fill_stat(inode, &e.attr);
+    fuse_reply_entry(req, &e);
+}
+
+/*
+ * Before changing a file's data: give it a block on first use (zeroed, it
+ * may hold stale data) or a private copy of a block shared with other files.
+ */
+static int own_data_block(struct assoofs_fuse *fs, struct assoofs_inode_info *inode) {
+    int err;
+
+    if (inode->data_block_number != ASSOOFS_NO_DATA_BLOCK)
+        return -assoofs_image_unshare_block(&fs->img, inode);
+    err = assoofs_image_alloc_block(&fs->img, &inode->data_block_number);
+    if (err)
+        return -err;
+    memset(assoofs_image_block(&fs->img, inode->data_block_number), 0, ASSOOFS_DEFAULT_BLOCK_SIZE);
+    return 0;
+}
+
+static void assoofs_fuse_init(void *userdata, struct fuse_conn_info *conn) {
+    /* Reads are answered by splicing straight from the image fd. */
+    if (conn->capable & FUSE_CAP_SPLICE_WRITE)
+        conn->want |= FUSE_CAP_SPLICE_WRITE;
+    if (conn->capable & FUSE_CAP_SPLICE_MOVE)
+        conn->want |= FUSE_CAP_SPLICE_MOVE;
+}
+
+static void assoofs_fuse_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    struct assoofs_fuse *fs = fs_of(req);
+    struct assoofs_inode_info *dir, *inode = NULL;
+
+    pthread_rwlock_rdlock(&fs->lock);
+    dir = assoofs_image_inode(&fs->img, TO_ASSOOFS_INO(parent));
+    if (dir)
+        inode = assoofs_image_lookup(&fs->img, dir, name);
+    if (inode)
+        reply_entry(req, inode);
+    else
+        fuse_reply_err(req, dir ? ENOENT : ESTALE);
+    pthread_rwlock_unlock(&fs->lock);
+}
+
+static void assoofs_fuse_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    struct assoofs_fuse *fs = fs_of(req);
+    struct assoofs_inode_info *inode;
+    struct stat st;
+
+    pthread_rwlock_rdlock(&fs->lock);
+    inode = assoofs_image_inode(&fs->img, TO_ASSOOFS_INO(ino));
+    if (inode) {
+        fill_stat(inode, &st);
+        fuse_reply_attr(req, &st, CACHE_TIMEOUT);
+    } else {
+        fuse_reply_err(req, ESTALE);
+    }
+    pthread_rwlock_unlock(&fs->lock);
+}
+
+static void assoofs_fuse_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
+                                 int to_set, struct fuse_file_info *fi) {
+    struct assoofs_fuse *fs = fs_of(req);
+    struct assoofs_inode_info *inode;
+    struct stat st;
+    char *data;
+    int err = 0;
+
+    pthread_rwlock_wrlock(&fs->lock);
+    inode = assoofs_image_inode(&fs->img, TO_ASSOOFS_INO(ino));
+    if (!inode) {
+        err = ESTALE;
+    } else if ((to_set & FUSE_SET_ATTR_SIZE) && !S_ISREG(inode->mode)) {
+        err = EISDIR;
+    } else if ((to_set & FUSE_SET_ATTR_SIZE) && attr->st_size > ASSOOFS_DEFAULT_BLOCK_SIZE) {
+        err = EFBIG;
+    } else {
+        if ((to_set & FUSE_SET_ATTR_SIZE) && (uint64_t)attr->st_size > inode->file_size) {
+            err = own_data_block(fs, inode);
+            if (!err) {
+                data = assoofs_image_block(&fs->img, inode->data_block_number);
+                memset(data + inode->file_size, 0, attr->st_size - inode->file_size);
+            }
+        }
+        if (!err && (to_set & FUSE_SET_ATTR_SIZE))
+            inode->file_size = attr->st_size;
+        if (to_set & FUSE_SET_ATTR_MODE)
+            inode->mode = (inode->mode & S_IFMT) | (attr->st_mode & 07777);
+    }
+    if (err) {
+        fuse_reply_err(req, err);
+    } else {
+        fill_stat(inode, &st);
+        fuse_reply_attr(req, &st, CACHE_TIMEOUT);
+    }
+    pthread_rwlock_unlock(&fs->lock);
+}
+
+static void assoofs_fuse_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                                 struct fuse_file_info *fi) {
+    struct assoofs_fuse *fs = fs_of(req);
+    struct assoofs_dir_record_entry *record = NULL;
+    struct assoofs_inode_info *dir, *child;
+    struct stat st;
+    char *buf;
+    size_t len = 0, entry;
+    uint64_t i;
+
+    buf = malloc(size);
+    if (!buf) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+
+    pthread_rwlock_rdlock(&fs->lock);
+    dir = assoofs_image_inode(&fs->img, TO_ASSOOFS_INO(ino));
+    if (dir)
+        record = assoofs_image_dirents(&fs->img, dir);
+    if (!record) {
+        pthread_rwlock_unlock(&fs->lock);
+        fuse_reply_err(req, dir ? ENOTDIR : ESTALE);
+        free(buf);
+        return;
+    }
+
+    /* off is the index of the next record to return */
+    for (i = off; i < dir->dir_children_count; i++) {
+        if (record[i].entry_removed != ASSOOFS_FALSE)
+            continue;
+        child = assoofs_image_inode(&fs->img, record[i].inode_no);
+        if (!child)
+            continue;
+        fill_stat(child, &st);
+        entry = fuse_add_direntry(req, buf + len, size - len, record[i].filename, &st, i + 1);
+        if (entry > size - len)
+            break;
+        len += entry;
+    }
+    pthread_rwlock_unlock(&fs->lock);
+
+    fuse_reply_buf(req, buf, len);
+    free(buf);
+}
+
+static void assoofs_fuse_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    /* Nobody else writes the image: keep the page cache across opens. */
+    fi->keep_cache = 1;
+    fuse_reply_open(req, fi);
+}
+
+static void assoofs_fuse_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                              struct fuse_file_info *fi) {
+    struct assoofs_fuse *fs = fs_of(req);
+    struct fuse_bufvec buf = FUSE_BUFVEC_INIT(0);
+    struct assoofs_inode_info *inode;
+
+    pthread_rwlock_rdlock(&fs->lock);
+    inode = assoofs_image_inode(&fs->img, TO_ASSOOFS_INO(ino));
+    if (!inode) {
+        fuse_reply_err(req, ESTALE);
+    } else if ((uint64_t)off >= inode->file_size || inode->data_block_number == ASSOOFS_NO_DATA_BLOCK) {
+        fuse_reply_buf(req, NULL, 0);
+    } else {
+        /* The kernel splices the bytes from the image fd into the reply. */
+        buf.buf[0].size = inode->file_size - off < size ? inode->file_size - off : size;
+        buf.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+        buf.buf[0].fd = fs->img.fd;
+        buf.buf[0].pos = inode->data_block_number * ASSOOFS_DEFAULT_BLOCK_SIZE + off;
+        fuse_reply_data(req, &buf, FUSE_BUF_SPLICE_MOVE);
+    }
+    pthread_rwlock_unlock(&fs->lock);
+}
+
+static void assoofs_fuse_write(fuse_req_t req, fuse_ino_t ino, const char *data, size_t size,
+                               off_t off, struct fuse_file_info *fi) {
+    struct assoofs_fuse *fs = fs_of(req);
+    struct assoofs_inode_info *inode;
+    char *block;
+    int err = 0;
+
+    pthread_rwlock_wrlock(&fs->lock);
+    inode = assoofs_image_inode(&fs->img, TO_ASSOOFS_INO(ino));
+    if (!inode)
+        err = ESTALE;
+    else if (off + size >= ASSOOFS_DEFAULT_BLOCK_SIZE)
+        err = ENOSPC; /* same test as assoofs_write: one block per file, its last byte unused */
+    else
+        err = own_data_block(fs, inode);
+
+    if (err) {
+        fuse_reply_err(req, err);
+    } else {
+        block = assoofs_image_block(&fs->img, inode->data_block_number);
+        memcpy(block + off, data, size);
+        if (off + size > inode->file_size)
+            inode->file_size = off + size;
+        fuse_reply_write(req, size);
+    }
+    pthread_rwlock_unlock(&fs->lock);
+}
+
+static void create_inode(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode,
+                         struct fuse_file_info *fi) {
+    struct assoofs_fuse *fs = fs_of(req);
+    struct assoofs_inode_info *dir, *inode = NULL;
+    struct fuse_entry_param e;
+    int err = -ESTALE;
+
+    pthread_rwlock_wrlock(&fs->lock);
+    dir = assoofs_image_inode(&fs->img, TO_ASSOOFS_INO(parent));
+    if (dir)
+        inode = assoofs_image_create(&fs->img, dir, name, mode, &err);
+    if (!inode) {
+        fuse_reply_err(req, -err);
+    } else if (fi) {
+        memset(&e, 0, sizeof(e));
+        e.ino = TO_FUSE_INO(inode->inode_no);
+        e.attr_timeout = CACHE_TIMEOUT;
+        e.entry_timeout = CACHE_TIMEOUT;
+        fill_stat(inode, &e.attr);
+        fi->keep_cache = 1;
+        fuse_reply_create(req, &e, fi);
+    } else {
+        reply_entry(req, inode);
+    }
+    pthread_rwlock_unlock(&fs->lock);
+}
+
+static void assoofs_fuse_create(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode,
+                                struct fuse_file_info *fi) {
+    if (!S_ISREG(mode)) {
+        fuse_reply_err(req, EPERM);
+        return;
+    }
+    create_inode(req, parent, name, mode, fi);
+}
+
+static void assoofs_fuse_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode) {
+    create_inode(req, parent, name, S_IFDIR | (mode & 07777), NULL);
+}
+
+static void assoofs_fuse_fsync(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi) {
+    struct assoofs_fuse *fs = fs_of(req);
+
+    fuse_reply_err(req, assoofs_image_sync(&fs->img) ? errno : 0);
+}
+
+static void assoofs_fuse_statfs(fuse_req_t req, fuse_ino_t ino) {
+    struct assoofs_fuse *fs = fs_of(req);
+    struct statvfs st;
+
+    memset(&st, 0, sizeof(st));
+    pthread_rwlock_rdlock(&fs->lock);
+    st.f_bsize = st.f_frsize = ASSOOFS_DEFAULT_BLOCK_SIZE;
+    /* The geometry mkassoofs -N and -s left in the bitmaps, not the 64 objects they can hold. */
+    st.f_blocks = assoofs_image_max_blocks(&fs->img);
+    st.f_bfree = st.f_bavail = __builtin_popcountll(fs->img.sb->free_blocks & assoofs_free_mask(0, st.f_blocks));
+    st.f_files = assoofs_image_max_inodes(&fs->img);
+    st.f_ffree = st.f_favail = __builtin_popcountll(fs->img.sb->free_inodes & assoofs_free_mask(0, st.f_files));
+    st.f_namemax = ASSOOFS_FILENAME_MAXLEN - 1;
+    pthread_rwlock_unlock(&fs->lock);
+    fuse_reply_statfs(req, &st);
+}
+
+static const struct fuse_lowlevel_ops assoofs_fuse_ops = {
+    .init = assoofs_fuse_init,
+    .lookup = assoofs_fuse_lookup,
+    .getattr = assoofs_fuse_getattr,
+    .setattr = assoofs_fuse_setattr,
+    .readdir = assoofs_fuse_readdir,
+    .open = assoofs_fuse_open,
+    .read = assoofs_fuse_read,
+    .write = assoofs_fuse_write,
+    .create = assoofs_fuse_create,
+    .mkdir = assoofs_fuse_mkdir,
+    .fsync = assoofs_fuse_fsync,
+    .statfs = assoofs_fuse_statfs,
+};
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args;
+    struct fuse_cmdline_opts opts;
+    struct fuse_loop_config config;
+    struct fuse_session *se;
+    struct assoofs_fuse fs;
+    const char *image;
+    int ret = 1;
+
+    if (argc < 3 || argv[1][0] == '-') {
+        printf("Usage: assoofs-fuse <device> <mountpoint> [FUSE options]\n");
+        fuse_cmdline_help();
+        return 1;
+    }
+    image = argv[1];
+    argv[1] = argv[0];
+    args = (struct fuse_args)FUSE_ARGS_INIT(argc - 1, argv + 1);
+
+    if (fuse_parse_cmdline(&args, &opts) != 0 || !opts.mountpoint) {
+        printf("Usage: assoofs-fuse <device> <mountpoint> [FUSE options]\n");
+        return 1;
+    }
+
+    if (assoofs_image_open(&fs.img, image, ASSOOFS_IMAGE_WRITE)) {
+        if (errno == EINVAL)
+            printf("%s: not an assoofs filesystem (bad superblock).\n", image);
+        else
+            perror(image);
+        goto out_args;
+    }
+    pthread_rwlock_init(&fs.lock, NULL);
+
+    se = fuse_session_new(&args, &assoofs_fuse_ops, sizeof(assoofs_fuse_ops), &fs);
+    if (!se)
+        goto out_image;
+    if (fuse_set_signal_handlers(se) != 0)
+        goto out_session;
+    if (fuse_session_mount(se, opts.mountpoint) != 0)
+        goto out_signals;
+
+    fuse_daemonize(opts.foreground);
+    if (opts.singlethread) {
+        ret = fuse_session_loop(se);
+    } else {
+        config.clone_fd = opts.clone_fd;
+        config.max_idle_threads = opts.max_idle_threads;
+        ret = fuse_session_loop_mt(se, &config);
+    }
+
+    fuse_session_unmount(se);
+out_signals:
+    fuse_remove_signal_handlers(se);
+out_session:
+    fuse_session_destroy(se);
+out_image:
+    assoofs_image_sync(&fs.img);
+    assoofs_image_close(&fs.img);
+    pthread_rwlock_destroy(&fs.lock);
+out_args:
+    free(opts.mountpoint);
+    fuse_opt_free_args(&args);
+    return ret ? 1 : 0;
+}
@@ -12,6 +12,8 @@ MODULE_AUTHOR("David Fernández Janeiro");
 struct assoofs_inode_info *assoofs_get_inode_info(struct super_block *sb, uint64_t inode_no);
 static struct inode *assoofs_get_inode(struct super_block *sb, int ino);
 int assoofs_sb_get_a_freeblock(struct super_block *sb, uint64_t *block);
+int assoofs_sb_get_a_freeinode(struct super_block *sb, uint64_t *ino);
+int assoofs_unshare_block(struct super_block *sb, struct assoofs_inode_info *inode_info);
 void assoofs_save_sb_info(struct super_block *vsb);
 void assoofs_add_inode_info(struct super_block *sb, struct assoofs_inode_info *inode);
 int assoofs_save_inode_info(struct super_block *sb, struct assoofs_inode_info *inode_info);
@@ -34,9 +36,9 @@ ssize_t assoofs_read(struct file *filp, char __user *buf, size_t len, loff_t *pp
     struct assoofs_inode_info *inode_info = filp->f_path.dentry->d_inode->i_private;
     int nbytes;
     long long unsigned int cp_to_user = 0;
-    if (*ppos >= inode_info->file_size)
+    if (*ppos >= inode_info->file_size || inode_info->data_block_number == ASSOOFS_NO_DATA_BLOCK)
     {
-        return 0;
+        return 0; // Un fichero sin bloque asignado todavia no tiene datos
     }
     bh = sb_bread(filp->f_path.dentry->d_inode->i_sb, inode_info->data_block_number);
     buffer = (char *)bh->b_data;
@@ -64,6 +66,21 @@ ssize_t assoofs_write(struct file *filp, const char __user *buf, size_t len, lof
         printk(KERN_ERR "No hay suficiente espacio en el disco para escribir.\n");
         return -ENOSPC;
     }
+    // Asignacion diferida: el bloque de datos se reserva con la primera escritura, no en assoofs_create
+    if (inode_info->data_block_number == ASSOOFS_NO_DATA_BLOCK)
+    {
+        if (assoofs_sb_get_a_freeblock(sb, &inode_info->data_block_number))
+        {
+            printk(KERN_ERR "No quedan bloques libres para el fichero.\n");
+            return -ENOSPC;
+        }
+    }
+    // Bloque compartido por deduplicacion (mkassoofs -d): se copia antes de escribir
+    else if (assoofs_unshare_block(sb, inode_info))
+    {
+        printk(KERN_ERR "No quedan bloques libres para copiar el bloque compartido.\n");
+        return -ENOSPC;
+    }
     bh = sb_bread(filp->f_path.dentry->d_inode->i_sb, inode_info->data_block_number);
     buffer = (char *)bh->b_data;
     buffer += *ppos;
@@ -167,29 +184,30 @@ static int assoofs_create(struct mnt_idmap *idmap, struct inode *dir, struct den
     struct assoofs_dir_record_entry *dir_contents;
     struct super_block *sb;
     struct buffer_head *bh;
-    uint64_t count;
+    uint64_t ino;
     printk(KERN_INFO "New file request (Se ha usado el comando TOUCH) \n");
-    sb = dir->i_sb;                                                           // obtengo un puntero al superbloque desde dir
-    count = ((struct assoofs_super_block_info *)sb->s_fs_info)->inodes_count; // obtengo el n´umero de inodos de la información persistente del superbloque
-    if (count < ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED)
+    sb = dir->i_sb; // obtengo un puntero al superbloque desde dir
+    if (assoofs_sb_get_a_freeinode(sb, &ino)) // El numero de inodos lo fija mkassoofs -N en el mapa free_inodes
     {
-        inode = new_inode(sb);
-        inode->i_sb = sb;
-        inode->i_atime = inode->i_mtime = inode->i_ctime = current_time(inode);
-        inode->i_op = &assoofs_inode_ops;
-        inode->i_ino = count + 1; // Asigno n´umero al nuevo inodo a partir de count
+        printk(KERN_ERR "No quedan inodos libres.\n");
+        return -ENOSPC;
     }
+    inode = new_inode(sb);
+    inode->i_sb = sb;
+    inode->i_atime = inode->i_mtime = inode->i_ctime = current_time(inode);
+    inode->i_op = &assoofs_inode_ops;
+    inode->i_ino = ino;
 
     inode_info = kmalloc(sizeof(struct assoofs_inode_info), GFP_KERNEL);
     inode_info->inode_no = inode->i_ino;
     inode_info->mode = mode; // El segundo mode me llega como argumento
     inode_info->file_size = 0;
+    inode_info->data_block_number = ASSOOFS_NO_DATA_BLOCK; // El bloque se asigna en assoofs_write, cuando hay datos
     inode->i_private = inode_info;
     inode->i_fop = &assoofs_file_operations;
     inode_init_owner(&nop_mnt_idmap, inode, dir, mode);
     d_add(dentry, inode);
 
-    assoofs_sb_get_a_freeblock(sb, &inode_info->data_block_number);
     assoofs_add_inode_info(sb, inode_info);
 
     parent_inode_info = dir->i_private;
@@ -198,6 +216,7 @@ static int assoofs_create(struct mnt_idmap *idmap, struct inode *dir, struct den
     dir_contents += parent_inode_info->dir_children_count;
     dir_contents->inode_no = inode_info->inode_no; // inode_info es la informaci´on persistente del inodo creado en el paso 2.
     strcpy(dir_contents->filename, dentry->d_name.name);
+    dir_contents->entry_removed = ASSOOFS_FALSE;
     mark_buffer_dirty(bh);
     sync_dirty_buffer(bh);
     brelse(bh);
@@ -214,20 +233,30 @@ static int assoofs_mkdir(struct mnt_idmap *idmap, struct inode *dir, struct dent
     struct assoofs_dir_record_entry *dir_contents;
     struct super_block *sb;
     struct buffer_head *bh;
-    uint64_t count;
-    sb = dir->i_sb;                                                           // obtengo un puntero al superbloque desde dir
-    count = ((struct assoofs_super_block_info *)sb->s_fs_info)->inodes_count; // obtengo el n´umero de inodos de la información persistente del superbloque
-    if (count < ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED)
+    uint64_t ino;
+    uint64_t block;
+    sb = dir->i_sb; // obtengo un puntero al superbloque desde dir
+    if (assoofs_sb_get_a_freeinode(sb, &ino))
+    {
+        printk(KERN_ERR "No quedan inodos libres.\n");
+        return -ENOSPC;
+    }
+    if (assoofs_sb_get_a_freeblock(sb, &block)) // Un directorio necesita su bloque desde el principio para las entradas
     {
-        inode = new_inode(sb);
-        inode->i_sb = sb;
-        inode->i_atime = inode->i_mtime = inode->i_ctime = current_time(inode);
-        inode->i_op = &assoofs_inode_ops;
-        inode->i_ino = count + 1; // Asigno n´umero al nuevo inodo a partir de count
+        printk(KERN_ERR "No quedan bloques libres para el directorio.\n");
+        ((struct assoofs_super_block_info *)sb->s_fs_info)->free_inodes |= (1ULL << ino); // Devuelvo el inodo reservado
+        assoofs_save_sb_info(sb);
+        return -ENOSPC;
     }
+    inode = new_inode(sb);
+    inode->i_sb = sb;
+    inode->i_atime = inode->i_mtime = inode->i_ctime = current_time(inode);
+    inode->i_op = &assoofs_inode_ops;
+    inode->i_ino = ino;
 
     inode_info = kmalloc(sizeof(struct assoofs_inode_info), GFP_KERNEL);
     inode_info->inode_no = inode->i_ino;
+    inode_info->data_block_number = block;
     inode_info->dir_children_count = 0;
     inode_info->mode = S_IFDIR | mode; // El segundo mode me llega como argumento
     inode->i_private = inode_info;
@@ -235,7 +264,6 @@ static int assoofs_mkdir(struct mnt_idmap *idmap, struct inode *dir, struct dent
     inode_init_owner(&nop_mnt_idmap, inode, dir, inode_info->mode);
     d_add(dentry, inode);
 
-    assoofs_sb_get_a_freeblock(sb, &inode_info->data_block_number);
     assoofs_add_inode_info(sb, inode_info);
 
     parent_inode_info = dir->i_private;
@@ -244,6 +272,7 @@ static int assoofs_mkdir(struct mnt_idmap *idmap, struct inode *dir, struct dent
     dir_contents += parent_inode_info->dir_children_count;
     dir_contents->inode_no = inode_info->inode_no; // inode_info es la informaci´on persistente del inodo creado en el paso 2.
     strcpy(dir_contents->filename, dentry->d_name.name);
+    dir_contents->entry_removed = ASSOOFS_FALSE;
     mark_buffer_dirty(bh);
     sync_dirty_buffer(bh);
     brelse(bh);
@@ -404,16 +433,70 @@ int assoofs_sb_get_a_freeblock(struct super_block *sb, uint64_t *block)
     struct assoofs_super_block_info *assoofs_sb = sb->s_fs_info;
     int i;
     printk(KERN_INFO "assoofs_sb_get_a_freeblock request (Buscamos un bloque libre) \n");
-    for (i = 2; i < ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED; i++)
+    for (i = ASSOOFS_LAST_RESERVED_BLOCK + 1; i < ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED; i++)
     {
-        if (assoofs_sb->free_blocks & (1 << i))
+        if (assoofs_sb->free_blocks & (1ULL << i))
         {
             break; // cuando aparece el primer bit 1 en free_block dejamos de recorrer el mapa de bits, i tiene la posici´on
                    // del primer bloque libre
         }
     }
+    if (i == ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED)
+    {
+        return -ENOSPC; // No hay ningun bit a 1: el dispositivo esta lleno
+    }
     *block = i;
-    assoofs_sb->free_blocks &= ~(1 << i);
+    assoofs_sb->free_blocks &= ~(1ULL << i);
+    assoofs_save_sb_info(sb);
+    return 0;
+}
+
+int assoofs_sb_get_a_freeinode(struct super_block *sb, uint64_t *ino)
+{
+    struct assoofs_super_block_info *assoofs_sb = sb->s_fs_info;
+    int i;
+    printk(KERN_INFO "assoofs_sb_get_a_freeinode request (Buscamos un inodo libre) \n");
+    for (i = ASSOOFS_LAST_RESERVED_INODE + 1; i < ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED; i++)
+    {
+        if (assoofs_sb->free_inodes & (1ULL << i))
+        {
+            break; // Mismo criterio que con los bloques: bit a 1 = inodo libre
+        }
+    }
+    if (i == ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED)
+    {
+        return -ENOSPC;
+    }
+    *ino = i;
+    assoofs_sb->free_inodes &= ~(1ULL << i);
+    assoofs_save_sb_info(sb);
+    return 0;
+}
+
+int assoofs_unshare_block(struct super_block *sb, struct assoofs_inode_info *inode_info)
+{
+    struct assoofs_super_block_info *assoofs_sb = sb->s_fs_info;
+    struct buffer_head *old_bh, *new_bh;
+    uint64_t block = inode_info->data_block_number;
+    uint64_t new_block;
+    if (block >= ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED || assoofs_sb->block_refcount[block] <= 1)
+    {
+        return 0; // Bloque propio: se escribe directamente
+    }
+    printk(KERN_INFO "assoofs_unshare_block request (Copiamos un bloque compartido antes de escribir) \n");
+    if (assoofs_sb_get_a_freeblock(sb, &new_block))
+    {
+        return -ENOSPC;
+    }
+    old_bh = sb_bread(sb, block);
+    new_bh = sb_bread(sb, new_block);
+    memcpy(new_bh->b_data, old_bh->b_data, ASSOOFS_DEFAULT_BLOCK_SIZE);
+    mark_buffer_dirty(new_bh);
+    sync_dirty_buffer(new_bh);
+    brelse(new_bh);
+    brelse(old_bh);
+    assoofs_sb->block_refcount[block]--;
+    inode_info->data_block_number = new_block;
     assoofs_save_sb_info(sb);
     return 0;
 }
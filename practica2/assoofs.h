@@ -1,15 +1,25 @@
+#ifndef ASSOOFS_H
+#define ASSOOFS_H
+
+#ifndef __KERNEL__
+#include <stdint.h>
+#include <sys/types.h>
+#endif
+
 #define ASSOOFS_MAGIC 0x20200406
 #define ASSOOFS_DEFAULT_BLOCK_SIZE 4096
 #define ASSOOFS_FILENAME_MAXLEN 255
 #define ASSOOFS_LAST_RESERVED_BLOCK ASSOOFS_ROOTDIR_BLOCK_NUMBER
 #define ASSOOFS_LAST_RESERVED_INODE ASSOOFS_ROOTDIR_INODE_NUMBER
-const int ASSOOFS_TRUE = 1;
-const int ASSOOFS_FALSE = 0;
-const int ASSOOFS_SUPERBLOCK_BLOCK_NUMBER = 0;  
-const int ASSOOFS_INODESTORE_BLOCK_NUMBER = 1;  
-const int ASSOOFS_ROOTDIR_BLOCK_NUMBER = 2;     
-const int ASSOOFS_ROOTDIR_INODE_NUMBER = 0;     
-const int ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED = 64;  
+#define ASSOOFS_TRUE 1
+#define ASSOOFS_FALSE 0
+#define ASSOOFS_SUPERBLOCK_BLOCK_NUMBER 0
+#define ASSOOFS_INODESTORE_BLOCK_NUMBER 1
+#define ASSOOFS_ROOTDIR_BLOCK_NUMBER 2
+#define ASSOOFS_ROOTDIR_INODE_NUMBER 0
+#define ASSOOFS_NO_DATA_BLOCK 0  // data_block_number de un fichero sin datos (el bloque 0 es el superbloque)
+#define ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED 64
+#define ASSOOFS_DIR_RECORDS_PER_BLOCK (ASSOOFS_DEFAULT_BLOCK_SIZE / sizeof(struct assoofs_dir_record_entry))
 
 struct assoofs_super_block_info {
     uint64_t version; 
@@ -18,7 +28,8 @@ struct assoofs_super_block_info {
     uint64_t inodes_count;
     uint64_t free_blocks;  
     uint64_t free_inodes;
-    char padding[4048];     
+    uint8_t block_refcount[ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED]; // inodos que comparten cada bloque (0 o 1 = no compartido)
+    char padding[3984];     
 };
 
 struct assoofs_dir_record_entry {
@@ -39,3 +50,4 @@ struct assoofs_inode_info {
     };
 };
 
+#endif /* ASSOOFS_H */
@@ -0,0 +1,79 @@
+#!/bin/sh
+# Benchmark assoofs on a loop device and print CSV to stdout.
+#
+#   sudo ./bench.sh [module|fuse] [rounds] > resultados.csv
+#
+# Every (test, threads, round) runs on a freshly formatted image, checks
+# it with fsck.assoofs afterwards and reports any inconsistency on stderr.
+# Environment: ITERATIONS (default 1000), THREADS (default "1 2 4 8"),
+# DROP_CACHES=1 to drop the dentry/inode caches before every lookup.
+set -e
+
+MODE=${1:-module}
+ROUNDS=${2:-3}
+ITERATIONS=${ITERATIONS:-1000}
+THREADS=${THREADS:-"1 2 4 8"}
+DIR=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d /tmp/assoofs-bench.XXXXXX)
+IMAGE=$WORK/image
+MNT=$WORK/mnt
+LOOP=
+
+if [ "$(id -u)" -ne 0 ]; then
+    echo "bench.sh needs root (losetup, mount)" >&2
+    exit 1
+fi
+
+cleanup() {
+    umount "$MNT" 2>/dev/null || true
+    [ -n "$LOOP" ] && losetup -d "$LOOP" 2>/dev/null || true
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+mkdir "$MNT"
+truncate -s 256k "$IMAGE"
+LOOP=$(losetup --find --show "$IMAGE")
+
+if [ "$MODE" = module ] && ! grep -q '^assoofs ' /proc/modules; then
+    insmod "$DIR/assoofs.ko"
+fi
+
+mount_fs() {
+    "$DIR/mkassoofs" "$LOOP" > /dev/null
+    if [ "$MODE" = fuse ]; then
+        "$DIR/assoofs-fuse" "$LOOP" "$MNT"
+    else
+        mount -t assoofs "$LOOP" "$MNT"
+    fi
+}
+
+umount_fs() {
+    umount "$MNT"
+    "$DIR/fsck.assoofs" "$LOOP" > "$WORK/fsck.log" || {
+        echo "fsck after $1:" >&2
+        cat "$WORK/fsck.log" >&2
+    }
+}
+
+run() {
+    test=$1
+    threads=$2
+    flags=
+    [ "${DROP_CACHES:-0}" = 1 ] && flags=-c
+    round=1
+    while [ "$round" -le "$ROUNDS" ]; do
+        mount_fs
+        "$DIR/assoofs-bench" -l "$MODE" -i "$ITERATIONS" -t "$threads" $flags "$MNT" "$test" || true
+        umount_fs "$test/$threads/$round"
+        round=$((round + 1))
+    done
+}
+
+"$DIR/assoofs-bench" -H
+for threads in $THREADS; do
+    run create "$threads"
+done
+for test in lookup-hit lookup-miss readdir write-small write-large read-small read-large; do
+    run "$test" 1
+done
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "libassoofs.h"
+
+/* Exit codes, as in fsck(8). */
+#define FSCK_OK 0
+#define FSCK_UNCORRECTED 4
+#define FSCK_ERROR 8
+
+struct fsck {
+    struct assoofs_image img;
+    int errors;
+    int warnings;
+    unsigned refs[ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED];        /* dirents naming each inode */
+    uint64_t block_owner[ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED]; /* inode_no + 1, 0 = unowned */
+    unsigned block_users[ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED]; /* inodes pointing at each block */
+    int reachable[ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED];
+};
+
+static void error(struct fsck *f, const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    printf("ERROR: ");
+    vprintf(fmt, ap);
+    printf("\n");
+    va_end(ap);
+    f->errors++;
+}
+
+static void warning(struct fsck *f, const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    printf("WARNING: ");
+    vprintf(fmt, ap);
+    printf("\n");
+    va_end(ap);
+    f->warnings++;
+}
+
+static void check_superblock(struct fsck *f) {
+    const struct assoofs_super_block_info *sb = f->img.sb;
+
+    if (sb->inodes_count != assoofs_image_inodes_count(&f->img))
+        error(f, "superblock inodes_count %llu does not fit in the inode store",
+              (unsigned long long)sb->inodes_count);
+    if (sb->inodes_count > ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED)
+        error(f, "superblock inodes_count %llu exceeds %d",
+              (unsigned long long)sb->inodes_count, ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED);
+    if (assoofs_block_is_free(&f->img, ASSOOFS_SUPERBLOCK_BLOCK_NUMBER) ||
+        assoofs_block_is_free(&f->img, ASSOOFS_INODESTORE_BLOCK_NUMBER))
+        error(f, "reserved blocks are marked free in the block bitmap");
+}
+
+static void claim_block(struct fsck *f, const struct assoofs_inode_info *inode) {
+    const struct assoofs_inode_info *owner;
+    uint64_t block = inode->data_block_number;
+
+    if (block >= f->img.blocks_count) {
+        error(f, "inode %llu: data block %llu is outside the device (%llu blocks)",
+              (unsigned long long)inode->inode_no, (unsigned long long)block,
+              (unsigned long long)f->img.blocks_count);
+        return;
+    }
+    if (block <= ASSOOFS_INODESTORE_BLOCK_NUMBER ||
+        (block == ASSOOFS_ROOTDIR_BLOCK_NUMBER && inode->inode_no != ASSOOFS_ROOTDIR_INODE_NUMBER)) {
+        error(f, "inode %llu: data block %llu is reserved",
+              (unsigned long long)inode->inode_no, (unsigned long long)block);
+        return;
+    }
+    /* Only deduplicated file blocks may be shared, see check_block_refcounts. */
+    owner = f->block_owner[block] ? assoofs_image_inode(&f->img, f->block_owner[block] - 1) : NULL;
+    if (f->block_owner[block] && (S_ISDIR(inode->mode) || !owner || S_ISDIR(owner->mode) ||
+                                  f->img.sb->block_refcount[block] <= 1))
+        error(f, "inode %llu: data block %llu is also used by inode %llu",
+              (unsigned long long)inode->inode_no, (unsigned long long)block,
+              (unsigned long long)(f->block_owner[block] - 1));
+    else if (!f->block_owner[block])
+        f->block_owner[block] = inode->inode_no + 1;
+    f->block_users[block]++;
+    if (assoofs_block_is_free(&f->img, block))
+        error(f, "inode %llu: data block %llu is marked free in the block bitmap",
+              (unsigned long long)inode->inode_no, (unsigned long long)block);
+}
+
+static void check_inodes(struct fsck *f) {
+    uint64_t seen = 0, i, max, count = assoofs_image_inodes_count(&f->img);
+    const struct assoofs_inode_info *inode;
+
+    for (i = 0; i < count; i++) {
+        inode = &f->img.inodes[i];
+        if (inode->inode_no >= ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED) {
+            error(f, "inode store entry %llu: inode number %llu out of range",
+                  (unsigned long long)i, (unsigned long long)inode->inode_no);
+            continue;
+        }
+        if (seen & (1ULL << inode->inode_no)) {
+            error(f, "inode %llu appears twice in the inode store", (unsigned long long)inode->inode_no);
+            continue;
+        }
+        seen |= 1ULL << inode->inode_no;
+        if (assoofs_inode_is_free(&f->img, inode->inode_no))
+            error(f, "inode %llu is marked free in the inode bitmap", (unsigned long long)inode->inode_no);
+
+        if (S_ISDIR(inode->mode)) {
+            if (inode->dir_children_count > ASSOOFS_DIR_RECORDS_PER_BLOCK)
+                error(f, "directory inode %llu: %llu entries do not fit in one block",
+                      (unsigned long long)inode->inode_no, (unsigned long long)inode->dir_children_count);
+            claim_block(f, inode);
+        } else if (S_ISREG(inode->mode)) {
+            if (inode->file_size > ASSOOFS_DEFAULT_BLOCK_SIZE)
+                error(f, "file inode %llu: size %llu is larger than a block",
+                      (unsigned long long)inode->inode_no, (unsigned long long)inode->file_size);
+            if (inode->data_block_number == ASSOOFS_NO_DATA_BLOCK) {
+                if (inode->file_size)
+                    error(f, "file inode %llu: %llu bytes but no data block",
+                          (unsigned long long)inode->inode_no, (unsigned long long)inode->file_size);
+            } else {
+                claim_block(f, inode);
+            }
+        } else {
+            error(f, "inode %llu: mode %o is neither a directory nor a regular file",
+                  (unsigned long long)inode->inode_no, (unsigned)inode->mode);
+        }
+    }
+
+    /* Past the geometry mkassoofs was given every bit reads as used. */
+    max = assoofs_image_max_inodes(&f->img);
+    for (i = 0; i < max; i++)
+        if (!(seen & (1ULL << i)) && !assoofs_inode_is_free(&f->img, i))
+            warning(f, "inode %llu is marked used but is not in the inode store (leaked)", (unsigned long long)i);
+}
+
+static void check_directory(struct fsck *f, const struct assoofs_inode_info *dir) {
+    const struct assoofs_dir_record_entry *record = assoofs_image_dirents(&f->img, dir);
+    const struct assoofs_inode_info *child;
+    uint64_t i, j;
+
+    if (!record)
+        return; /* reported by check_inodes */
+
+    for (i = 0; i < dir->dir_children_count; i++) {
+        if (record[i].entry_removed != ASSOOFS_FALSE)
+            continue;
+        if (!memchr(record[i].filename, '\0', ASSOOFS_FILENAME_MAXLEN) || !record[i].filename[0]) {
+            error(f, "directory inode %llu: entry %llu has an invalid name",
+                  (unsigned long long)dir->inode_no, (unsigned long long)i);
+            continue;
+        }
+        for (j = 0; j < i; j++)
+            if (record[j].entry_removed == ASSOOFS_FALSE &&
+                !strncmp(record[i].filename, record[j].filename, ASSOOFS_FILENAME_MAXLEN))
+                error(f, "directory inode %llu: duplicate entry '%s'",
+                      (unsigned long long)dir->inode_no, record[i].filename);
+
+        child = assoofs_image_inode(&f->img, record[i].inode_no);
+        if (!child || record[i].inode_no == ASSOOFS_ROOTDIR_INODE_NUMBER) {
+            error(f, "directory inode %llu: entry '%s' points to invalid inode %llu",
+                  (unsigned long long)dir->inode_no, record[i].filename, (unsigned long long)record[i].inode_no);
+            continue;
+        }
+        if (f->refs[child->inode_no]++)
+            error(f, "inode %llu is linked from more than one directory entry ('%s')",
+                  (unsigned long long)child->inode_no, record[i].filename);
+    }
+}
+
+/* Depth-first walk from the root; every inode must be reached exactly once. */
+static void walk(struct fsck *f, const struct assoofs_inode_info *dir) {
+    const struct assoofs_dir_record_entry *record = assoofs_image_dirents(&f->img, dir);
+    const struct assoofs_inode_info *child;
+    uint64_t i;
+
+    if (!record)
+        return;
+    for (i = 0; i < dir->dir_children_count; i++) {
+        if (record[i].entry_removed != ASSOOFS_FALSE)
+            continue;
+        child = assoofs_image_inode(&f->img, record[i].inode_no);
+        if (!child || f->reachable[child->inode_no])
+            continue;
+        f->reachable[child->inode_no] = 1;
+        if (S_ISDIR(child->mode))
+            walk(f, child);
+    }
+}
+
+static void check_tree(struct fsck *f) {
+    const struct assoofs_inode_info *root = assoofs_image_inode(&f->img, ASSOOFS_ROOTDIR_INODE_NUMBER);
+    uint64_t i, count = assoofs_image_inodes_count(&f->img);
+
+    if (!root || !S_ISDIR(root->mode) || root->data_block_number != ASSOOFS_ROOTDIR_BLOCK_NUMBER) {
+        error(f, "root directory inode is missing or damaged");
+        return;
+    }
+
+    for (i = 0; i < count; i++)
+        if (S_ISDIR(f->img.inodes[i].mode))
+            check_directory(f, &f->img.inodes[i]);
+
+    f->reachable[ASSOOFS_ROOTDIR_INODE_NUMBER] = 1;
+    walk(f, root);
+    for (i = 0; i < count; i++)
+        if (f->img.inodes[i].inode_no < ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED &&
+            !f->reachable[f->img.inodes[i].inode_no])
+            warning(f, "inode %llu is not reachable from the root directory (orphan)",
+                    (unsigned long long)f->img.inodes[i].inode_no);
+}
+
+static void check_block_refcounts(struct fsck *f) {
+    const uint8_t *refcount = f->img.sb->block_refcount;
+    uint64_t block;
+
+    for (block = 0; block < ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED; block++) {
+        if (refcount[block] <= 1 && f->block_users[block] <= 1)
+            continue;
+        if (refcount[block] != f->block_users[block])
+            error(f, "block %llu: reference count %u but %u inodes use it",
+                  (unsigned long long)block, refcount[block], f->block_users[block]);
+    }
+}
+
+static void check_block_bitmap(struct fsck *f) {
+    uint64_t block, max = assoofs_image_max_blocks(&f->img);
+
+    for (block = ASSOOFS_ROOTDIR_BLOCK_NUMBER; block < max; block++)
+        if (!f->block_owner[block] && !assoofs_block_is_free(&f->img, block))
+            warning(f, "block %llu is marked used but no inode owns it (leaked)", (unsigned long long)block);
+    for (block = f->img.blocks_count; block < ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED; block++)
+        if (assoofs_block_is_free(&f->img, block))
+            error(f, "block %llu is marked free but lies past the end of the device", (unsigned long long)block);
+}
+
+int main(int argc, char *argv[])
+{
+    struct fsck *f;
+    int ret;
+
+    if (argc != 2) {
+        printf("Usage: fsck.assoofs <device>\n");
+        return FSCK_ERROR;
+    }
+
+    f = calloc(1, sizeof(*f));
+    if (!f) {
+        perror("Error allocating the checker state");
+        return FSCK_ERROR;
+    }
+    if (assoofs_image_open(&f->img, argv[1], 0)) {
+        if (errno == EINVAL)
+            printf("%s: not an assoofs filesystem (bad superblock).\n", argv[1]);
+        else
+            perror(argv[1]);
+        free(f);
+        return FSCK_ERROR;
+    }
+
+    check_superblock(f);
+    check_inodes(f);
+    check_tree(f);
+    check_block_refcounts(f);
+    check_block_bitmap(f);
+
+    printf("%s: %llu inodes, %llu blocks, %d errors, %d warnings.\n", argv[1],
+           (unsigned long long)f->img.sb->inodes_count, (unsigned long long)f->img.blocks_count,
+           f->errors, f->warnings);
+    /* Nothing is repaired, so leaks and orphans are left uncorrected too. */
+    ret = f->errors || f->warnings ? FSCK_UNCORRECTED : FSCK_OK;
+    assoofs_image_close(&f->img);
+    free(f);
+    return ret;
+}
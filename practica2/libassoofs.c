@@ -0,0 +1,238 @@
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include "libassoofs.h"
+
+#define INODES_PER_BLOCK (ASSOOFS_DEFAULT_BLOCK_SIZE / sizeof(struct assoofs_inode_info))
+
+int assoofs_image_open(struct assoofs_image *img, const char *path, int flags) {
+    int writable = flags & ASSOOFS_IMAGE_WRITE;
+    struct stat st;
+    uint64_t size;
+    int err;
+
+    /* O_EXCL without O_CREAT only means something for block devices: it is ignored for image files. */
+    memset(img, 0, sizeof(*img));
+    img->fd = open(path, (writable ? O_RDWR : O_RDONLY) | (flags & ASSOOFS_IMAGE_EXCL ? O_EXCL : 0));
+    if (img->fd == -1)
+        return -1;
+
+    if (fstat(img->fd, &st) == -1)
+        goto fail;
+    if (S_ISBLK(st.st_mode)) {
+        if (ioctl(img->fd, BLKGETSIZE64, &size) == -1)
+            goto fail;
+    } else {
+        size = st.st_size;
+    }
+
+    /* Only the blocks the bitmaps can address are ever touched. */
+    img->blocks_count = size / ASSOOFS_DEFAULT_BLOCK_SIZE;
+    if (img->blocks_count > ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED)
+        img->blocks_count = ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED;
+    if (img->blocks_count <= ASSOOFS_LAST_RESERVED_BLOCK) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    img->size = img->blocks_count * ASSOOFS_DEFAULT_BLOCK_SIZE;
+    img->base = mmap(NULL, img->size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                     MAP_SHARED, img->fd, 0);
+    if (img->base == MAP_FAILED) {
+        img->base = NULL;
+        goto fail;
+    }
+
+    img->sb = (struct assoofs_super_block_info *)assoofs_image_block(img, ASSOOFS_SUPERBLOCK_BLOCK_NUMBER);
+    img->inodes = (struct assoofs_inode_info *)assoofs_image_block(img, ASSOOFS_INODESTORE_BLOCK_NUMBER);
+    if (img->sb->magic != ASSOOFS_MAGIC || img->sb->block_size != ASSOOFS_DEFAULT_BLOCK_SIZE) {
+        errno = EINVAL;
+        goto fail;
+    }
+    return 0;
+
+fail:
+    err = errno;
+    assoofs_image_close(img);
+    errno = err;
+    return -1;
+}
+
+void assoofs_image_close(struct assoofs_image *img) {
+    if (img->base)
+        munmap(img->base, img->size);
+    if (img->fd != -1)
+        close(img->fd);
+    img->base = NULL;
+    img->fd = -1;
+}
+
+int assoofs_image_sync(struct assoofs_image *img) {
+    return msync(img->base, img->size, MS_SYNC);
+}
+
+uint64_t assoofs_image_inodes_count(const struct assoofs_image *img) {
+    return img->sb->inodes_count < INODES_PER_BLOCK ? img->sb->inodes_count : INODES_PER_BLOCK;
+}
+
+uint64_t assoofs_geometry(uint64_t free_map, uint64_t highest_used) {
+    uint64_t max = highest_used + 1;
+
+    if (free_map && 64 - __builtin_clzll(free_map) > max)
+        max = 64 - __builtin_clzll(free_map);
+    return max;
+}
+
+uint64_t assoofs_free_mask(uint64_t used, uint64_t max) {
+    uint64_t mask = max >= 64 ? ~0ULL : (1ULL << max) - 1;
+
+    return used >= 64 ? 0 : mask & ((~0ULL) << used);
+}
+
+uint64_t assoofs_image_max_inodes(const struct assoofs_image *img) {
+    uint64_t i, highest = ASSOOFS_ROOTDIR_INODE_NUMBER, count = assoofs_image_inodes_count(img);
+
+    for (i = 0; i < count; i++)
+        if (img->inodes[i].inode_no < 64 && img->inodes[i].inode_no > highest)
+            highest = img->inodes[i].inode_no;
+    return assoofs_geometry(img->sb->free_inodes, highest);
+}
+
+uint64_t assoofs_image_max_blocks(const struct assoofs_image *img) {
+    uint64_t i, max, highest = ASSOOFS_ROOTDIR_BLOCK_NUMBER, count = assoofs_image_inodes_count(img);
+
+    for (i = 0; i < count; i++)
+        if (img->inodes[i].data_block_number < 64 && img->inodes[i].data_block_number > highest)
+            highest = img->inodes[i].data_block_number;
+    max = assoofs_geometry(img->sb->free_blocks, highest);
+    return max < img->blocks_count ? max : img->blocks_count;
+}
+
+void *assoofs_image_block(const struct assoofs_image *img, uint64_t block) {
+    if (block >= img->blocks_count)
+        return NULL;
+    return img->base + block * ASSOOFS_DEFAULT_BLOCK_SIZE;
+}
+
+struct assoofs_inode_info *assoofs_image_inode(const struct assoofs_image *img, uint64_t inode_no) {
+    uint64_t i, count = assoofs_image_inodes_count(img);
+
+    for (i = 0; i < count; i++)
+        if (img->inodes[i].inode_no == inode_no)
+            return &img->inodes[i];
+    return NULL;
+}
+
+struct assoofs_dir_record_entry *assoofs_image_dirents(const struct assoofs_image *img,
+                                                       const struct assoofs_inode_info *dir) {
+    if (!S_ISDIR(dir->mode) || dir->dir_children_count > ASSOOFS_DIR_RECORDS_PER_BLOCK)
+        return NULL;
+    return assoofs_image_block(img, dir->data_block_number);
+}
+
+struct assoofs_inode_info *assoofs_image_lookup(const struct assoofs_image *img,
+                                                const struct assoofs_inode_info *dir, const char *name) {
+    struct assoofs_dir_record_entry *record = assoofs_image_dirents(img, dir);
+    uint64_t i;
+
+    if (!record)
+        return NULL;
+    for (i = 0; i < dir->dir_children_count; i++, record++)
+        if (record->entry_removed == ASSOOFS_FALSE &&
+            !strncmp(record->filename, name, ASSOOFS_FILENAME_MAXLEN))
+            return assoofs_image_inode(img, record->inode_no);
+    return NULL;
+}
+
+int assoofs_image_alloc_block(struct assoofs_image *img, uint64_t *block) {
+    uint64_t i;
+
+    for (i = ASSOOFS_LAST_RESERVED_BLOCK + 1; i < img->blocks_count; i++) {
+        if (assoofs_block_is_free(img, i)) {
+            img->sb->free_blocks &= ~(1ULL << i);
+            *block = i;
+            return 0;
+        }
+    }
+    return -ENOSPC;
+}
+
+int assoofs_image_unshare_block(struct assoofs_image *img, struct assoofs_inode_info *inode) {
+    uint64_t old = inode->data_block_number, new;
+    int err;
+
+    if (old >= ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED || img->sb->block_refcount[old] <= 1)
+        return 0;
+    err = assoofs_image_alloc_block(img, &new);
+    if (err)
+        return err;
+    memcpy(assoofs_image_block(img, new), assoofs_image_block(img, old), ASSOOFS_DEFAULT_BLOCK_SIZE);
+    img->sb->block_refcount[old]--;
+    inode->data_block_number = new;
+    return 0;
+}
+
+static struct assoofs_inode_info *new_inode(struct assoofs_image *img, mode_t mode, int *err) {
+    struct assoofs_inode_info *inode;
+    uint64_t i;
+
+    if (img->sb->inodes_count >= INODES_PER_BLOCK) {
+        *err = -ENOSPC;
+        return NULL;
+    }
+    for (i = ASSOOFS_LAST_RESERVED_INODE + 1; i < ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED; i++)
+        if (assoofs_inode_is_free(img, i))
+            break;
+    if (i == ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED) {
+        *err = -ENOSPC;
+        return NULL;
+    }
+
+    inode = &img->inodes[img->sb->inodes_count];
+    inode->mode = mode;
+    inode->inode_no = i;
+    inode->data_block_number = ASSOOFS_NO_DATA_BLOCK; /* files get their block on first write */
+    inode->file_size = 0;
+    if (S_ISDIR(mode) && (*err = assoofs_image_alloc_block(img, &inode->data_block_number)))
+        return NULL;
+
+    img->sb->free_inodes &= ~(1ULL << i);
+    img->sb->inodes_count++;
+    return inode;
+}
+
+struct assoofs_inode_info *assoofs_image_create(struct assoofs_image *img, struct assoofs_inode_info *dir,
+                                                const char *name, mode_t mode, int *err) {
+    struct assoofs_dir_record_entry *record = assoofs_image_dirents(img, dir);
+    struct assoofs_inode_info *inode;
+
+    *err = 0;
+    if (!record)
+        *err = -ENOTDIR;
+    else if (strlen(name) >= ASSOOFS_FILENAME_MAXLEN)
+        *err = -ENAMETOOLONG;
+    else if (assoofs_image_lookup(img, dir, name))
+        *err = -EEXIST;
+    else if (dir->dir_children_count == ASSOOFS_DIR_RECORDS_PER_BLOCK)
+        *err = -ENOSPC;
+    if (*err)
+        return NULL;
+
+    inode = new_inode(img, mode, err);
+    if (!inode)
+        return NULL;
+
+    record += dir->dir_children_count;
+    memset(record, 0, sizeof(*record));
+    strcpy(record->filename, name);
+    record->inode_no = inode->inode_no;
+    record->entry_removed = ASSOOFS_FALSE;
+    dir->dir_children_count++;
+    return inode;
+}
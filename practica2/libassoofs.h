@@ -0,0 +1,85 @@
+#ifndef LIBASSOOFS_H
+#define LIBASSOOFS_H
+
+#include <stddef.h>
+#include "assoofs.h"
+
+/*
+ * Userspace access to an assoofs image (image file or block device).
+ * The addressable part of the image is mmap'ed and every structure is
+ * returned as a pointer into the mapping: nothing is copied or decoded.
+ */
+struct assoofs_image {
+    int fd;
+    char *base;                           /* mapping of blocks 0 .. blocks_count - 1 */
+    size_t size;                          /* bytes mapped */
+    uint64_t blocks_count;                /* blocks present on the device (<= 64) */
+    struct assoofs_super_block_info *sb;
+    struct assoofs_inode_info *inodes;    /* inode store, sb->inodes_count entries */
+};
+
+/* Flags for assoofs_image_open. */
+#define ASSOOFS_IMAGE_WRITE 1   /* map the image writable */
+#define ASSOOFS_IMAGE_EXCL  2   /* block devices: fail with EBUSY if mounted or open elsewhere */
+
+/* Return 0 on success, -1 with errno set otherwise (EINVAL: not an assoofs image). */
+int assoofs_image_open(struct assoofs_image *img, const char *path, int flags);
+void assoofs_image_close(struct assoofs_image *img);
+
+/* sb->inodes_count clamped to what the inode store block can hold. */
+uint64_t assoofs_image_inodes_count(const struct assoofs_image *img);
+
+/*
+ * Objects 0 .. highest free or used one. mkassoofs -N and -s only set the
+ * free bits below the limits they were given, so the bits past them read
+ * as used and the highest free bit is all that records the geometry.
+ */
+uint64_t assoofs_geometry(uint64_t free_map, uint64_t highest_used);
+
+/* Bitmap with objects used .. max - 1 marked free, the way mkassoofs writes it. */
+uint64_t assoofs_free_mask(uint64_t used, uint64_t max);
+
+/* Geometry of the image: inodes from the inode store, blocks capped at blocks_count. */
+uint64_t assoofs_image_max_inodes(const struct assoofs_image *img);
+uint64_t assoofs_image_max_blocks(const struct assoofs_image *img);
+
+/* Flush a writable mapping to the device. */
+int assoofs_image_sync(struct assoofs_image *img);
+
+/* NULL when the block lies outside the image. */
+void *assoofs_image_block(const struct assoofs_image *img, uint64_t block);
+
+/* Entry of the inode store with the given inode number, NULL if absent. */
+struct assoofs_inode_info *assoofs_image_inode(const struct assoofs_image *img, uint64_t inode_no);
+
+/* First record of a directory's entry block, NULL if dir is not a readable directory. */
+struct assoofs_dir_record_entry *assoofs_image_dirents(const struct assoofs_image *img,
+                                                       const struct assoofs_inode_info *dir);
+
+/* Child of dir called name, NULL if there is none. */
+struct assoofs_inode_info *assoofs_image_lookup(const struct assoofs_image *img,
+                                                const struct assoofs_inode_info *dir, const char *name);
+
+/*
+ * Writers for a writable image, following the module's rules: bit set =
+ * free, the lowest free object after the reserved ones is taken.
+ * Errors are negative errnos (-ENOSPC, -EEXIST, -ENAMETOOLONG, -ENOTDIR).
+ */
+int assoofs_image_alloc_block(struct assoofs_image *img, uint64_t *block);
+
+/* Copy-on-write: give inode a private copy of a block shared through block_refcount. */
+int assoofs_image_unshare_block(struct assoofs_image *img, struct assoofs_inode_info *inode);
+
+/* New file or directory (by mode) named name in dir; NULL with *err set on failure. */
+struct assoofs_inode_info *assoofs_image_create(struct assoofs_image *img, struct assoofs_inode_info *dir,
+                                                const char *name, mode_t mode, int *err);
+
+static inline int assoofs_block_is_free(const struct assoofs_image *img, uint64_t block) {
+    return block < 64 && (img->sb->free_blocks & (1ULL << block)) != 0;
+}
+
+static inline int assoofs_inode_is_free(const struct assoofs_image *img, uint64_t inode_no) {
+    return inode_no < 64 && (img->sb->free_inodes & (1ULL << inode_no)) != 0;
+}
+
+#endif /* LIBASSOOFS_H */
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdio.h>
 #include <sys/types.h>
@@ -6,157 +7,387 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include "assoofs.h"
-
-#define WELCOMEFILE_DATABLOCK_NUMBER (ASSOOFS_LAST_RESERVED_BLOCK + 1)
-#define WELCOMEFILE_INODE_NUMBER (ASSOOFS_LAST_RESERVED_INODE + 1)
-
-static int write_superblock(int fd) {
-    struct assoofs_super_block_info sb = {
-        .version = 1,
-        .magic = ASSOOFS_MAGIC,
-        .block_size = ASSOOFS_DEFAULT_BLOCK_SIZE,
-        .inodes_count = 2,   // DIRECTORIO RAIZ y README.txt
-        .free_blocks = (15), // 1111 En binario
-        .free_inodes = (3),  // 11 En binario
-    };
-    ssize_t ret;
+#include <dirent.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include "libassoofs.h"
 
-    ret = write(fd, &sb, sizeof(sb));
-    if (ret != ASSOOFS_DEFAULT_BLOCK_SIZE) {
-        printf("Bytes written [%d] are not equal to the default block size.\n", (int)ret);
-        return -1;
-    }
 
-    printf("Super block written succesfully.\n");
-    return 0;
-}
+#define USAGE "Usage: mkassoofs [-d <directory>] [-N <inodes>] [-s <size>[k|m|g]] [-K] <device>\n"
 
-static int write_root_inode(int fd) {
-    ssize_t ret;
+/*
+ * In-memory image: every block the filesystem can address is built here and
+ * written to the device with a single pwrite, metadata and data together.
+ */
+struct image {
+    char *blocks;
+    struct assoofs_inode_info *inodes; /* inode store, points into blocks */
+    uint64_t inodes_count;
+    uint64_t blocks_count;             /* blocks 0 .. blocks_count - 1 are used */
+    uint64_t max_inodes;               /* geometry chosen with -N */
+    uint64_t max_blocks;               /* geometry derived from the device or -s */
+    uint64_t data_blocks[ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED]; /* file data blocks written so far */
+    uint64_t data_hash[ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED];   /* and the hash of their contents */
+    uint64_t data_count;
+    uint64_t shared_files;             /* files pointed at another file's block */
+};
 
-    struct assoofs_inode_info root_inode;
+static char *image_block(struct image *img, uint64_t block) {
+    return img->blocks + block * ASSOOFS_DEFAULT_BLOCK_SIZE;
+}
 
-    root_inode.mode = S_IFDIR;
-    root_inode.inode_no = ASSOOFS_ROOTDIR_INODE_NUMBER;
-    root_inode.data_block_number = ASSOOFS_ROOTDIR_BLOCK_NUMBER;
-    root_inode.dir_children_count = 1;
+static struct assoofs_inode_info *image_new_inode(struct image *img, mode_t mode) {
+    struct assoofs_inode_info *inode;
 
-    ret = write(fd, &root_inode, sizeof(root_inode));
+    if (img->inodes_count == img->max_inodes) {
+        printf("Too many files: the filesystem has %llu inodes.\n", (unsigned long long)img->max_inodes);
+        return NULL;
+    }
+    inode = &img->inodes[img->inodes_count];
+    inode->mode = mode;
+    inode->inode_no = img->inodes_count++;
+    inode->data_block_number = ASSOOFS_NO_DATA_BLOCK;
+    inode->file_size = 0;
+    return inode;
+}
 
-    if (ret != sizeof(root_inode)) {
-        printf("The inode store was not written properly.\n");
+static int image_new_block(struct image *img, uint64_t *block) {
+    if (img->blocks_count == img->max_blocks) {
+        printf("Out of space: the filesystem has %llu blocks.\n", (unsigned long long)img->max_blocks);
         return -1;
     }
-
-    printf("root directory inode written succesfully.\n");
+    *block = img->blocks_count++;
     return 0;
 }
 
-static int write_welcome_inode(int fd, const struct assoofs_inode_info *i) {
-    off_t nbytes;
+/* FNV-1a: files are at most one block, so a simple hash plus memcmp is enough. */
+static uint64_t hash_block(const char *data) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    int i;
+
+    for (i = 0; i < ASSOOFS_DEFAULT_BLOCK_SIZE; i++)
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+/*
+ * Identical files share one data block. The superblock keeps how many inodes
+ * point at it so that assoofs_write copies the block before changing it.
+ */
+static int image_add_file(struct image *img, const char *path, const struct stat *st,
+                          struct assoofs_inode_info *inode) {
+    struct assoofs_super_block_info *sb;
+    char data[ASSOOFS_DEFAULT_BLOCK_SIZE];
+    uint64_t hash, i, block;
     ssize_t ret;
+    int fd;
 
-    ret = write(fd, i, sizeof(*i));
-    if (ret != sizeof(*i)) {
-        printf("The welcomefile inode was not written properly.\n");
+    if (st->st_size > ASSOOFS_DEFAULT_BLOCK_SIZE) {
+        printf("%s: %lld bytes do not fit in one block.\n", path, (long long)st->st_size);
         return -1;
     }
-    printf("welcomefile inode written succesfully.\n");
+    inode->file_size = st->st_size;
+    if (st->st_size == 0)
+        return 0; /* empty files get their block on first write */
 
-    nbytes = ASSOOFS_DEFAULT_BLOCK_SIZE - (sizeof(*i) * 2);
-    ret = lseek(fd, nbytes, SEEK_CUR);
-    if (ret == (off_t)-1) {
-        printf("The padding bytes are not written properly.\n");
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror(path);
         return -1;
     }
+    memset(data, 0, sizeof(data));
+    ret = read(fd, data, st->st_size);
+    close(fd);
+    if (ret != st->st_size) {
+        printf("%s: short read.\n", path);
+        return -1;
+    }
+
+    hash = hash_block(data);
+    for (i = 0; i < img->data_count; i++) {
+        block = img->data_blocks[i];
+        if (img->data_hash[i] == hash && !memcmp(image_block(img, block), data, sizeof(data))) {
+            sb = (struct assoofs_super_block_info *)image_block(img, ASSOOFS_SUPERBLOCK_BLOCK_NUMBER);
+            sb->block_refcount[block] = sb->block_refcount[block] ? sb->block_refcount[block] + 1 : 2;
+            inode->data_block_number = block;
+            img->shared_files++;
+            return 0;
+        }
+    }
 
-    printf("inode store padding bytes (after two inodes) written sucessfully.\n");
+    if (image_new_block(img, &inode->data_block_number))
+        return -1;
+    memcpy(image_block(img, inode->data_block_number), data, sizeof(data));
+    img->data_blocks[img->data_count] = inode->data_block_number;
+    img->data_hash[img->data_count++] = hash;
     return 0;
 }
 
-int write_dirent(int fd, const struct assoofs_dir_record_entry *record) {
-    ssize_t nbytes = sizeof(*record), ret;
+static int skip_dots(const struct dirent *d) {
+    return strcmp(d->d_name, ".") && strcmp(d->d_name, "..");
+}
+
+/*
+ * Depth-first walk: a directory's entry block is followed by the data of its
+ * children in name order, so the image is laid out in one streaming pass.
+ */
+static int image_add_directory(struct image *img, const char *path, struct assoofs_inode_info *dir) {
+    struct assoofs_dir_record_entry *record;
+    struct assoofs_inode_info *child;
+    struct dirent **names;
+    char child_path[PATH_MAX];
+    struct stat st;
+    int i, n, ret = -1;
 
-    ret = write(fd, record, nbytes);
-    if (ret != nbytes) {
-        printf("Writing the rootdirectory datablock (name+inode_no pair for welcomefile) has failed.\n");
+    if (image_new_block(img, &dir->data_block_number))
         return -1;
-    }
-    printf("root directory datablocks (name+inode_no pair for welcomefile) written succesfully.\n");
+    record = (struct assoofs_dir_record_entry *)image_block(img, dir->data_block_number);
 
-    nbytes = ASSOOFS_DEFAULT_BLOCK_SIZE - sizeof(*record);
-    ret = lseek(fd, nbytes, SEEK_CUR);
-    if (ret == (off_t)-1) {
-        printf("Writing the padding for rootdirectory children datablock has failed.\n");
+    n = scandir(path, &names, skip_dots, alphasort);
+    if (n == -1) {
+        perror(path);
         return -1;
     }
-    printf("Padding after the rootdirectory children written succesfully.\n");
+
+    for (i = 0; i < n; i++) {
+        snprintf(child_path, sizeof(child_path), "%s/%s", path, names[i]->d_name);
+        if (lstat(child_path, &st) == -1) {
+            perror(child_path);
+            goto out;
+        }
+        if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
+            printf("Skipping %s: neither a directory nor a regular file.\n", child_path);
+            continue;
+        }
+        if (strlen(names[i]->d_name) >= ASSOOFS_FILENAME_MAXLEN) {
+            printf("%s: file name too long.\n", child_path);
+            goto out;
+        }
+        if (dir->dir_children_count == ASSOOFS_DIR_RECORDS_PER_BLOCK) {
+            printf("%s: more than %d entries do not fit in a directory block.\n", path, (int)ASSOOFS_DIR_RECORDS_PER_BLOCK);
+            goto out;
+        }
+
+        child = image_new_inode(img, st.st_mode & (S_IFMT | 0777));
+        if (!child)
+            goto out;
+        if (S_ISDIR(st.st_mode) ? image_add_directory(img, child_path, child)
+                                : image_add_file(img, child_path, &st, child))
+            goto out;
+
+        strcpy(record[dir->dir_children_count].filename, names[i]->d_name);
+        record[dir->dir_children_count].inode_no = child->inode_no;
+        record[dir->dir_children_count].entry_removed = ASSOOFS_FALSE;
+        dir->dir_children_count++;
+    }
+    ret = 0;
+out:
+    for (i = 0; i < n; i++)
+        free(names[i]);
+    free(names);
+    return ret;
+}
+
+/* Default contents when no -d is given: a root directory with README.txt. */
+static int image_add_welcome_file(struct image *img, struct assoofs_inode_info *root) {
+    static const char welcomefile_body[] = "Hola mundo, os saludo desde un sistema de ficheros ASSOOFS.\n";
+    struct assoofs_dir_record_entry *record;
+    struct assoofs_inode_info *welcome;
+
+    if (image_new_block(img, &root->data_block_number))
+        return -1;
+    welcome = image_new_inode(img, S_IFREG);
+    if (!welcome || image_new_block(img, &welcome->data_block_number))
+        return -1;
+    welcome->file_size = sizeof(welcomefile_body);
+    memcpy(image_block(img, welcome->data_block_number), welcomefile_body, sizeof(welcomefile_body));
+
+    record = (struct assoofs_dir_record_entry *)image_block(img, root->data_block_number);
+    strcpy(record->filename, "README.txt");
+    record->inode_no = welcome->inode_no;
+    record->entry_removed = ASSOOFS_FALSE;
+    root->dir_children_count = 1;
     return 0;
 }
 
-int write_block(int fd, char *block, size_t len) {
+static int write_image(int fd, struct image *img) {
+    struct assoofs_super_block_info *sb;
+    size_t len;
     ssize_t ret;
 
-    ret = write(fd, block, len);
-    if (ret != len) {
-        printf("Writing file body has failed.\n");
+    sb = (struct assoofs_super_block_info *)image_block(img, ASSOOFS_SUPERBLOCK_BLOCK_NUMBER);
+    sb->version = 1;
+    sb->magic = ASSOOFS_MAGIC;
+    sb->block_size = ASSOOFS_DEFAULT_BLOCK_SIZE;
+    sb->inodes_count = img->inodes_count;
+    sb->free_blocks = assoofs_free_mask(img->blocks_count, img->max_blocks);
+    sb->free_inodes = assoofs_free_mask(img->inodes_count, img->max_inodes);
+
+    len = img->blocks_count * ASSOOFS_DEFAULT_BLOCK_SIZE;
+    ret = pwrite(fd, img->blocks, len, 0);
+    if (ret != (ssize_t)len) {
+        printf("Writing the image has failed.\n");
         return -1;
     }
-    printf("block has been written succesfully.\n");
+    printf("%llu/%llu inodes and %llu/%llu blocks written.\n",
+           (unsigned long long)img->inodes_count, (unsigned long long)img->max_inodes,
+           (unsigned long long)img->blocks_count, (unsigned long long)img->max_blocks);
+    if (img->shared_files)
+        printf("%llu duplicate files share another file's data block.\n", (unsigned long long)img->shared_files);
+    return 0;
+}
+
+/*
+ * Tell the device that everything after the image is unused instead of
+ * writing zeros: BLKDISCARD on block devices, a punched hole on image files.
+ */
+static void discard_rest(int fd, const struct stat *st, uint64_t from, uint64_t to) {
+    uint64_t range[2] = { from, to - from };
+    int ret;
+
+    if (from >= to)
+        return;
+    if (S_ISBLK(st->st_mode))
+        ret = ioctl(fd, BLKDISCARD, range);
+    else
+        ret = fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, from, to - from);
+    if (ret == -1 && errno != EOPNOTSUPP)
+        perror("Discarding the unused space has failed");
+    else if (ret == 0)
+        printf("%llu unused bytes discarded.\n", (unsigned long long)(to - from));
+}
+
+static int parse_size(const char *arg, uint64_t *size) {
+    char *end;
+
+    *size = strtoull(arg, &end, 10);
+    switch (*end) {
+    case 'g': case 'G':
+        *size <<= 10;
+        /* fall through */
+    case 'm': case 'M':
+        *size <<= 10;
+        /* fall through */
+    case 'k': case 'K':
+        *size <<= 10;
+        end++;
+    }
+    return end == arg || *end != '\0' ? -1 : 0;
+}
+
+static int device_size(int fd, const struct stat *st, uint64_t *size) {
+    if (S_ISBLK(st->st_mode))
+        return ioctl(fd, BLKGETSIZE64, size);
+    *size = st->st_size;
     return 0;
 }
 
 int main(int argc, char *argv[])
 {
-    int fd;
-    ssize_t ret;
-    char welcomefile_body[] = "Hola mundo, os saludo desde un sistema de ficheros ASSOOFS.\n";
-    
-    struct assoofs_inode_info welcome = {
-        .mode = S_IFREG,
-        .inode_no = WELCOMEFILE_INODE_NUMBER,
-        .data_block_number = WELCOMEFILE_DATABLOCK_NUMBER,
-        .file_size = sizeof(welcomefile_body),
-    };
-    
-    struct assoofs_dir_record_entry record = {
-        .filename = "README.txt",
-        .inode_no = WELCOMEFILE_INODE_NUMBER,
-        .entry_removed = ASSOOFS_FALSE,
-    };
-
-    if (argc != 2) {
-        printf("Usage: mkassoofs <device>\n");
+    struct assoofs_inode_info *root;
+    struct image img;
+    struct stat st;
+    const char *source_dir = NULL;
+    uint64_t size = 0, dev_size;
+    long inodes = ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED;
+    int fd, opt, discard = 1;
+    int ret;
+
+    while ((opt = getopt(argc, argv, "d:N:s:K")) != -1) {
+        switch (opt) {
+        case 'd':
+            source_dir = optarg;
+            break;
+        case 'N':
+            inodes = strtol(optarg, NULL, 10);
+            if (inodes < 2 || inodes > ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED) {
+                printf("The inode count must be between 2 and %d.\n", ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED);
+                return -1;
+            }
+            break;
+        case 's':
+            if (parse_size(optarg, &size)) {
+                printf("Invalid size '%s'.\n", optarg);
+                return -1;
+            }
+            break;
+        case 'K':
+            discard = 0;
+            break;
+        default:
+            printf(USAGE);
+            return -1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        printf(USAGE);
         return -1;
     }
 
-    fd = open(argv[1], O_RDWR);
+    fd = open(argv[optind], O_RDWR);
     if (fd == -1) {
         perror("Error opening the device");
         return -1;
     }
 
     ret = 1;
+    memset(&img, 0, sizeof(img));
     do {
-        if (write_superblock(fd))
+        if (fstat(fd, &st) == -1 || device_size(fd, &st, &dev_size) == -1) {
+            perror("Error reading the device size");
             break;
+        }
+
+        /* Without -s the filesystem takes the whole device; an empty image
+         * file is grown to the largest size the block bitmap can address. */
+        if (!size)
+            size = dev_size ? dev_size : (uint64_t)ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED * ASSOOFS_DEFAULT_BLOCK_SIZE;
+        if (size > dev_size) {
+            if (!S_ISREG(st.st_mode)) {
+                printf("The device is smaller than %llu bytes.\n", (unsigned long long)size);
+                break;
+            }
+            if (ftruncate(fd, size) == -1) {
+                perror("Error growing the image file");
+                break;
+            }
+        }
 
-        if (write_root_inode(fd))
+        img.max_inodes = inodes;
+        img.max_blocks = size / ASSOOFS_DEFAULT_BLOCK_SIZE;
+        if (img.max_blocks > ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED)
+            img.max_blocks = ASSOOFS_MAX_FILESYSTEM_OBJECTS_SUPPORTED;
+        if (img.max_blocks < ASSOOFS_LAST_RESERVED_BLOCK + 2) {
+            printf("The device is too small for an assoofs filesystem.\n");
             break;
-        
-        if (write_welcome_inode(fd, &welcome))
+        }
+
+        img.blocks = calloc(img.max_blocks, ASSOOFS_DEFAULT_BLOCK_SIZE);
+        if (!img.blocks) {
+            perror("Error allocating the image");
             break;
+        }
+        img.inodes = (struct assoofs_inode_info *)image_block(&img, ASSOOFS_INODESTORE_BLOCK_NUMBER);
+        img.inodes_count = 0;
+        img.blocks_count = ASSOOFS_ROOTDIR_BLOCK_NUMBER; /* superblock and inode store */
 
-        if (write_dirent(fd, &record))
+        root = image_new_inode(&img, S_IFDIR);
+        if (source_dir ? image_add_directory(&img, source_dir, root) : image_add_welcome_file(&img, root))
             break;
-        
-        if (write_block(fd, welcomefile_body, welcome.file_size))
+
+        if (write_image(fd, &img))
             break;
 
+        if (discard)
+            discard_rest(fd, &st, img.blocks_count * ASSOOFS_DEFAULT_BLOCK_SIZE, size);
+
         ret = 0;
     } while (0);
 
+    free(img.blocks);
     close(fd);
     return ret;
 }
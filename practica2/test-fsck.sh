@@ -0,0 +1,77 @@
+#!/bin/sh
+# Format images with every mkassoofs geometry and check that fsck.assoofs
+# finds nothing to report, then damage one and check that it exits with 4
+# and names the problem. No root needed: only image files are used.
+#
+#   ./test-fsck.sh          (or "make check")
+set -e
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d /tmp/assoofs-test.XXXXXX)
+FAILED=0
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir "$WORK/tree" "$WORK/tree/sub"
+echo hello > "$WORK/tree/a"
+echo world > "$WORK/tree/sub/b"
+
+# check <device size> <mkassoofs options...>
+check() {
+    size=$1
+    shift
+    rm -f "$WORK/image"
+    truncate -s "$size" "$WORK/image"
+    "$DIR/mkassoofs" "$@" "$WORK/image" > /dev/null
+    if out=$("$DIR/fsck.assoofs" "$WORK/image") && echo "$out" | grep -q ' 0 errors, 0 warnings\.$'; then
+        echo "ok      $size $*"
+    else
+        echo "FAILED  $size $*"
+        echo "$out" | sed 's/^/    /'
+        FAILED=1
+    fi
+}
+
+check 256k
+check 256k -N 10
+check 1M -s 128k
+check 1M -N 10 -s 128k
+check 1M -s 128k -d "$WORK/tree"
+check 256k -N 8 -d "$WORK/tree"
+
+# poke <offset> <byte>: overwrite one byte of the image
+poke() {
+    printf "\\$(printf %o "$2")" | dd of="$WORK/image" bs=1 seek="$1" conv=notrunc status=none
+}
+
+# corrupt <description> <expected message> <offset> <byte> [<offset> <byte>...]
+# Image built from tree: inode store entries root, a, sub, sub/b (32 bytes
+# each, at 4096) with data blocks 2, 3, 4 and 5; root records (272 bytes
+# each, at 8192) a and sub.
+corrupt() {
+    what=$1
+    pattern=$2
+    shift 2
+    rm -f "$WORK/image"
+    truncate -s 256k "$WORK/image"
+    "$DIR/mkassoofs" -d "$WORK/tree" "$WORK/image" > /dev/null
+    while [ $# -gt 0 ]; do
+        poke "$1" "$2"
+        shift 2
+    done
+    status=0
+    out=$("$DIR/fsck.assoofs" "$WORK/image") || status=$?
+    if [ $status -eq 4 ] && echo "$out" | grep -q "$pattern"; then
+        echo "ok      $what"
+    else
+        echo "FAILED  $what (exit status $status)"
+        echo "$out" | sed 's/^/    /'
+        FAILED=1
+    fi
+}
+
+corrupt "directory block shared with a file" "also used by inode 2" 4208 4 52 2
+corrupt "leaked block" "block 6 is marked used but no inode owns it" 32 128
+corrupt "duplicate name" "duplicate entry 'a'" 8464 97 8465 0
+corrupt "orphan inode" "inode 2 is not reachable" 4120 1
+
+exit $FAILED